@@ -1,9 +1,15 @@
 #ifndef ALLOCATOR_H
 #define ALLOCATOR_H
 
+// posix_memalign, the mmap flags and madvise are hidden by a strict -std=c11,
+// this has to come before the first system header
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stddef.h> // size_t
-#include <stdlib.h> // malloc / free / realloc
-#include <strings.h> // memset / memcpy
+#include <stdlib.h> // malloc / free / realloc / posix_memalign
+#include <string.h> // memset / memcpy
 #include <stdio.h> // printf for debugging
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -16,15 +22,38 @@
 #define MIN_ALLOC_BLOCK (((size_t)1) << 20)
 #endif
 
+// alignment of every allocation that does not ask for a specific one, same as
+// malloc. alloc_realloc only guarantees this alignment
+#ifndef ALLOC_DEFAULT_ALIGN
+#define ALLOC_DEFAULT_ALIGN (sizeof(void *)*2)
+#endif
+
+// rounds 'v' up to 'align', which must be a power of two
+static size_t alloc_align_up(size_t v, size_t align) {
+	return (v + (align-1)) & ~(align-1);
+}
+
+#define ALLOC_BATCH_FAILED ((void *)-1)
+
 typedef enum AllocatorOPCode {
 	ALLOC_ALLOC,
 	ALLOC_FREE,
 	ALLOC_FREE_ALL,
 	ALLOC_REALLOC,
+	// batches return a non null pointer when handled and 0 when not supported,
+	// alloc_new_batch / alloc_free_batch then fall back to one call per
+	// pointer. a batch that failed returns ALLOC_BATCH_FAILED, nothing may be
+	// left allocated and it is not retried
+	ALLOC_ALLOC_BATCH,
+	ALLOC_FREE_BATCH,
+	// returns a non null pointer when the allocator knows 'ptr' came from it,
+	// 0 when it did not or when it can not tell
+	ALLOC_OWNS,
 } AllocatorOPCode;
 
 typedef struct AllocatorAlloc {
 	 size_t size;
+	 size_t align; // power of two, 0 means ALLOC_DEFAULT_ALIGN
 #ifdef BLIB_DEBUG
 	 const char *file;
 	 int line;
@@ -49,12 +78,38 @@ typedef struct AllocatorRealloc {
 #endif
 } AllocatorRealloc;
 
+typedef struct AllocatorAllocBatch {
+	 size_t size;
+	 size_t count;
+	 void **out;
+#ifdef BLIB_DEBUG
+	 const char *file;
+	 int line;
+#endif
+} AllocatorAllocBatch;
+
+typedef struct AllocatorFreeBatch {
+	 void **ptrs;
+	 size_t count;
+#ifdef BLIB_DEBUG
+	 const char *file;
+	 int line;
+#endif
+} AllocatorFreeBatch;
+
+typedef struct AllocatorOwns {
+	 void *ptr;
+} AllocatorOwns;
+
 typedef struct AllocatorOP {
 	 AllocatorOPCode opcode;
 	 union {
 		 AllocatorAlloc alloc;
 		 AllocatorFree free;
 		 AllocatorRealloc realloc;
+		 AllocatorAllocBatch alloc_batch;
+		 AllocatorFreeBatch free_batch;
+		 AllocatorOwns owns;
 	 } data;
 } AllocatorOP;
 
@@ -68,11 +123,20 @@ typedef struct Allocator {
 
 #define alloc_new(a, s)\
 _alloc_new((a), (s), __FILE__, __LINE__)
+#define alloc_new_aligned(a, s, al)\
+_alloc_new_aligned((a), (s), (al), __FILE__, __LINE__)
 #define alloc_free(a, p) _alloc_free((a), (p), __FILE__, __LINE__)
 #define alloc_realloc(a, p, o, n)\
 _alloc_realloc((a),(p),(o),(n), __FILE__, __LINE__)
+#define alloc_new_batch(a, s, c, o)\
+_alloc_new_batch((a), (s), (c), (o), __FILE__, __LINE__)
+#define alloc_free_batch(a, p, c)\
+_alloc_free_batch((a), (p), (c), __FILE__, __LINE__)
 
 static void *_alloc_new(Allocator *a, size_t size, const char *file, int line);
+static void *_alloc_new_aligned(
+	Allocator *a, size_t size, size_t align, const char *file, int line
+);
 static void _alloc_free(Allocator *a, void *ptr, const char *file, int line);
 static void alloc_free_all(Allocator *a);
 static void *_alloc_realloc(
@@ -83,13 +147,27 @@ static void *_alloc_realloc(
 	const char *file,
 	int line
 );
+static int _alloc_new_batch(
+	Allocator *a,
+	size_t size,
+	size_t count,
+	void **out,
+	const char *file,
+	int line
+);
+static void _alloc_free_batch(
+	Allocator *a, void **ptrs, size_t count, const char *file, int line
+);
 
 #else
 
 static void *alloc_new(Allocator *a, size_t size);
+static void *alloc_new_aligned(Allocator *a, size_t size, size_t align);
 static void alloc_free(Allocator *a, void *ptr);
 static void alloc_free_all(Allocator *a);
 static void *alloc_realloc(Allocator *a, void *ptr, size_t oldsz, size_t newsz);
+static int alloc_new_batch(Allocator *a, size_t size, size_t count, void **out);
+static void alloc_free_batch(Allocator *a, void **ptrs, size_t count);
 
 #endif //BLIB_DEBUG
 
@@ -103,6 +181,18 @@ static void *_alloc_new(Allocator *a, size_t size, const char *file, int line) {
 	return a->alloc_fn(a, op);
 }
 
+static void *_alloc_new_aligned(
+	Allocator *a, size_t size, size_t align, const char *file, int line
+) {
+	AllocatorOP op;
+	op.opcode = ALLOC_ALLOC;
+	AllocatorAlloc data = {
+		.size = size, .align = align, .file = file, .line = line
+	};
+	op.data.alloc = data;
+	return a->alloc_fn(a, op);
+}
+
 static void _alloc_free(Allocator *a, void *ptr, const char *file, int line) {
 	AllocatorOP op;
 	op.opcode = ALLOC_FREE;
@@ -134,6 +224,45 @@ static void *_alloc_realloc(
 	return a->alloc_fn(a, op);
 }
 
+static int _alloc_new_batch(
+	Allocator *a,
+	size_t size,
+	size_t count,
+	void **out,
+	const char *file,
+	int line
+) {
+	AllocatorOP op = {0};
+	void *r = 0;
+	AllocatorAllocBatch data = {
+		.size = size, .count = count, .out = out, .file = file, .line = line
+	};
+	op.opcode = ALLOC_ALLOC_BATCH;
+	op.data.alloc_batch = data;
+	if (!count) return 0;
+	if ((r = a->alloc_fn(a, op)) == ALLOC_BATCH_FAILED) return -1;
+	if (r) return 0;
+	for (size_t i = 0; i < count; i++) {
+		if ((out[i] = _alloc_new(a, size, file, line))) continue;
+		for (; i > 0; i--) _alloc_free(a, out[i-1], file, line);
+		return -1;
+	}
+	return 0;
+}
+
+static void _alloc_free_batch(
+	Allocator *a, void **ptrs, size_t count, const char *file, int line
+) {
+	AllocatorOP op = {0};
+	AllocatorFreeBatch data = {
+		.ptrs = ptrs, .count = count, .file = file, .line = line
+	};
+	op.opcode = ALLOC_FREE_BATCH;
+	op.data.free_batch = data;
+	if (!count || a->alloc_fn(a, op)) return;
+	for (size_t i = 0; i < count; i++) _alloc_free(a, ptrs[i], file, line);
+}
+
 #else
 
 static void *alloc_new(Allocator *a, size_t size) {
@@ -144,6 +273,14 @@ static void *alloc_new(Allocator *a, size_t size) {
 	return a->alloc_fn(a, op);
 }
 
+static void *alloc_new_aligned(Allocator *a, size_t size, size_t align) {
+	AllocatorOP op = {0};
+	op.opcode = ALLOC_ALLOC;
+	AllocatorAlloc data = { .size = size, .align = align };
+	op.data.alloc = data;
+	return a->alloc_fn(a, op);
+}
+
 static void alloc_free(Allocator *a, void *ptr) {
 	AllocatorOP op = {0};
 	op.opcode = ALLOC_FREE;
@@ -168,6 +305,41 @@ static void *alloc_realloc(Allocator *a, void *old, size_t oldsz, size_t newsz)
 	return a->alloc_fn(a, op);
 }
 
+static int alloc_new_batch(Allocator *a, size_t size, size_t count, void **out) {
+	AllocatorOP op = {0};
+	void *r = 0;
+	AllocatorAllocBatch data = { .size = size, .count = count, .out = out };
+	op.opcode = ALLOC_ALLOC_BATCH;
+	op.data.alloc_batch = data;
+	if (!count) return 0;
+	if ((r = a->alloc_fn(a, op)) == ALLOC_BATCH_FAILED) return -1;
+	if (r) return 0;
+	for (size_t i = 0; i < count; i++) {
+		if ((out[i] = alloc_new(a, size))) continue;
+		for (; i > 0; i--) alloc_free(a, out[i-1]);
+		return -1;
+	}
+	return 0;
+}
+
+static void alloc_free_batch(Allocator *a, void **ptrs, size_t count) {
+	AllocatorOP op = {0};
+	AllocatorFreeBatch data = { .ptrs = ptrs, .count = count };
+	op.opcode = ALLOC_FREE_BATCH;
+	op.data.free_batch = data;
+	if (!count || a->alloc_fn(a, op)) return;
+	for (size_t i = 0; i < count; i++) alloc_free(a, ptrs[i]);
+}
+
 #endif //BLIB_DEBUG
 
+// lets compositions of allocators send a pointer back to the one that
+// allocated it
+static int alloc_owns(Allocator *a, void *ptr) {
+	AllocatorOP op = {0};
+	op.opcode = ALLOC_OWNS;
+	op.data.owns = (AllocatorOwns){ .ptr = ptr };
+	return ptr && a->alloc_fn(a, op) != 0;
+}
+
 #endif // ALLOCATOR_H
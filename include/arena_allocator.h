@@ -9,48 +9,303 @@ typedef struct ArenaBlock {
 	size_t len;
 } ArenaBlock;
 
+// what ALLOC_FREE_ALL keeps from the backing allocator, so loops that free
+// all the arena memory on every iteration reach a steady state without
+// backing allocations
+typedef enum ArenaRetention {
+	ARENA_RETAIN_FIRST, // keeps the oldest block, the default
+	ARENA_RETAIN_LARGEST, // keeps the largest block
+	ARENA_RETAIN_BYTES, // keeps up to 'retain_bytes' of blocks on a free list
+	ARENA_RETAIN_HIGH_WATER, // keeps one block sized to the peak bytes used
+} ArenaRetention;
+
+// older blocks with a tail of free space that small allocations can still use
+#ifndef ARENA_PARTIAL_BLOCKS
+#define ARENA_PARTIAL_BLOCKS 4
+#endif
+
+// smallest tail worth keeping track of
+#ifndef ARENA_PARTIAL_MIN
+#define ARENA_PARTIAL_MIN 256
+#endif
+
 typedef struct ArenaAllocator {
 	Allocator *backing;
 	ArenaBlock *last_block;
+	ArenaBlock *large_blocks; // dedicated to allocations over a block
+	ArenaBlock *partial[ARENA_PARTIAL_BLOCKS]; // blocks of the last_block chain
+	ArenaRetention retention;
+	size_t retain_bytes;
+	ArenaBlock *free_blocks; // ARENA_RETAIN_BYTES
+	size_t free_bytes;
+	size_t used; // bytes allocated in every block but the last one
+	size_t peak; // bytes allocated at once since the last free all
+	size_t block; // bytes of a block, without its header
+	// span of every block taken from the backing allocator, arena_owns rejects
+	// the pointers outside of it without walking the blocks
+	size_t lo;
+	size_t hi;
 } ArenaAllocator;
 
-static int arena_grow(ArenaAllocator *a, size_t sz) {
-	if (!a) return -1;
+// the last block is left out of 'used' so the fast path only bumps its length,
+// the peak is taken when it grows and before anything is given back
+static size_t arena_used(ArenaAllocator *a) {
+	return a->used + (a->last_block ? a->last_block->len : 0);
+}
+
+static void arena_note_peak(ArenaAllocator *a) {
+	size_t used = arena_used(a);
+	if (used > a->peak) a->peak = used;
+}
+
+static void arena_forget_partial(ArenaAllocator *a, ArenaBlock *b) {
+	for (size_t i = 0; i < ARENA_PARTIAL_BLOCKS; i++) {
+		if (a->partial[i] == b) a->partial[i] = 0;
+	}
+}
+
+// returns the block to the backing allocator, unless the retention policy
+// keeps it in the free list
+static void arena_release_block(ArenaAllocator *a, ArenaBlock *b) {
+	arena_forget_partial(a, b);
+	if (
+		a->retention == ARENA_RETAIN_BYTES &&
+		a->free_bytes + b->cap <= a->retain_bytes
+	) {
+		b->len = 0;
+		b->prev = a->free_blocks;
+		a->free_blocks = b;
+		a->free_bytes += b->cap;
+		return;
+	}
+	alloc_free(a->backing, b);
+}
+
+// takes the first retained block with room for 'sz' bytes
+static ArenaBlock *arena_reuse_block(ArenaAllocator *a, size_t sz) {
+	for (ArenaBlock **b = &a->free_blocks; *b; b = &(*b)->prev) {
+		if ((*b)->cap < sz) continue;
+		ArenaBlock *r = *b;
+		*b = r->prev;
+		a->free_bytes -= r->cap;
+		return r;
+	}
+	return 0;
+}
+
+static ArenaBlock *arena_new_block(ArenaAllocator *a, size_t sz) {
 	size_t blocksz = sizeof(ArenaBlock);
-	size_t datasz = MAX(sz, MIN_ALLOC_BLOCK);
+	size_t datasz = MAX(sz, a->block);
 	size_t allocsz = 0;
-	ArenaBlock *oldblk = 0;
 	unsigned char *allocp = 0;
+	ArenaBlock *b = 0;
 	//
-	oldblk = a->last_block;
+	if ((b = arena_reuse_block(a, sz))) return b;
 	allocsz = blocksz + datasz;
-	if (!(allocp = alloc_new(a->backing, allocsz))) return -1;
-	*((ArenaBlock *)allocp) = (ArenaBlock){0};
-	a->last_block = (ArenaBlock *)allocp;
+	if (!(allocp = alloc_new(a->backing, allocsz))) return 0;
+	if (!a->hi || (size_t)allocp < a->lo) a->lo = (size_t)allocp;
+	a->hi = MAX(a->hi, (size_t)allocp + allocsz);
+	b = (ArenaBlock *)allocp;
+	*b = (ArenaBlock){0};
 	allocp += blocksz;
-	a->last_block->base = allocp;
-	a->last_block->cap = datasz;
-	a->last_block->prev = oldblk;
+	b->base = allocp;
+	b->cap = datasz;
+	return b;
+}
+
+static int arena_grow(ArenaAllocator *a, size_t sz) {
+	if (!a) return -1;
+	ArenaBlock *b = 0;
+	if (!(b = arena_new_block(a, sz))) return -1;
+	arena_note_peak(a);
+	if (a->last_block) a->used += a->last_block->len;
+	b->prev = a->last_block;
+	a->last_block = b;
 	return 0;
 }
 
-static void *arena_alloc(ArenaAllocator *a, size_t sz) {
-	if (!a->last_block && arena_grow(a, sz)) return 0; 
-	if (a->last_block->cap - a->last_block->len < sz && arena_grow(a, sz))
-		return 0;
-	void *r = (void*) (
-		(a->last_block->len) + (size_t) a->last_block->base
-	);
-	a->last_block->len += sz;
+// bytes needed to align the next allocation of the block to 'align'
+static size_t arena_pad(ArenaBlock *b, size_t align) {
+	size_t next = b->len + (size_t)b->base;
+	return alloc_align_up(next, align) - next;
+}
+
+static void *arena_bump(ArenaBlock *b, size_t sz, size_t align) {
+	size_t pad = arena_pad(b, align);
+	size_t room = b->cap - b->len;
+	if (sz > room || pad > room - sz) return 0;
+	void *r = (void*) ((b->len + pad) + (size_t) b->base);
+	b->len += pad + sz;
 	return r;
 }
 
+// serves the allocation from the tail of an older block
+static void *arena_alloc_partial(ArenaAllocator *a, size_t sz, size_t align) {
+	void *r = 0;
+	for (size_t i = 0; i < ARENA_PARTIAL_BLOCKS; i++) {
+		ArenaBlock *b = a->partial[i];
+		size_t len = b ? b->len : 0;
+		if (!b || !(r = arena_bump(b, sz, align))) continue;
+		a->used += b->len - len;
+		if (b->cap - b->len < ARENA_PARTIAL_MIN) a->partial[i] = 0;
+		return r;
+	}
+	return 0;
+}
+
+// remembers the tail of a block that stopped being the last one, replacing
+// the smallest tail known if there is no room
+static void arena_keep_partial(ArenaAllocator *a, ArenaBlock *b) {
+	size_t tail = b->cap - b->len;
+	size_t min = 0;
+	if (tail < ARENA_PARTIAL_MIN) return;
+	for (size_t i = 0; i < ARENA_PARTIAL_BLOCKS; i++) {
+		if (!a->partial[i]) {
+			a->partial[i] = b;
+			return;
+		}
+		ArenaBlock *m = a->partial[min];
+		if (a->partial[i]->cap - a->partial[i]->len < m->cap - m->len) min = i;
+	}
+	ArenaBlock *m = a->partial[min];
+	if (m->cap - m->len < tail) a->partial[min] = b;
+}
+
+static void *arena_alloc_aligned(ArenaAllocator *a, size_t sz, size_t align) {
+	if (!align) align = ALLOC_DEFAULT_ALIGN;
+	ArenaBlock *b = a->last_block;
+	void *r = 0;
+	if (b && (r = arena_bump(b, sz, align))) return r;
+	// oversized requests get their own block, the last block keeps its tail.
+	// the new block may not be aligned, reserve room for the padding
+	if (b && sz > a->block) {
+		if (!(b = arena_new_block(a, sz + align - 1))) return 0;
+		b->prev = a->large_blocks;
+		a->large_blocks = b;
+		r = arena_bump(b, sz, align);
+		a->used += b->len;
+		return r;
+	}
+	if ((r = arena_alloc_partial(a, sz, align))) return r;
+	if (arena_grow(a, sz + align - 1)) return 0;
+	if (b) arena_keep_partial(a, b);
+	return arena_bump(a->last_block, sz, align);
+}
+
+static void *arena_alloc(ArenaAllocator *a, size_t sz) {
+	return arena_alloc_aligned(a, sz, ALLOC_DEFAULT_ALIGN);
+}
+
+// bump allocation that skips building an AllocatorOP and the alloc_fn
+// dispatch, for hot loops where the allocator is known to be an arena. only
+// the slow path, when the block is full, is not inlined
+static inline void *arena_alloc_fast(Allocator *a, size_t sz) {
+	ArenaBlock *b = ((ArenaAllocator *)a->state)->last_block;
+	if (b) {
+		size_t r = alloc_align_up((size_t)b->base + b->len, ALLOC_DEFAULT_ALIGN);
+		size_t end = r + sz - (size_t)b->base;
+		if (end <= b->cap && end >= sz) {
+			b->len = end;
+			return (void *)r;
+		}
+	}
+	return arena_alloc((ArenaAllocator *)a->state, sz);
+}
+
+// one bump for the whole batch, the pointers are ALLOC_DEFAULT_ALIGN apart
+static void *arena_alloc_batch(
+	ArenaAllocator *a, size_t sz, size_t count, void **out
+) {
+	size_t stride = alloc_align_up(sz, ALLOC_DEFAULT_ALIGN);
+	unsigned char *p = 0;
+	if (stride && count > ((size_t)-1) / stride) return ALLOC_BATCH_FAILED;
+	if (!(p = arena_alloc(a, stride*count))) return ALLOC_BATCH_FAILED;
+	for (size_t i = 0; i < count; i++) out[i] = p + i*stride;
+	return out;
+}
+
+static int arena_resize_last(
+	ArenaAllocator *a, void *old, size_t oldsz, size_t newsz
+) {
+	ArenaBlock *b = a->last_block;
+	if (!b || !old) return 0;
+	size_t off = (size_t)old - (size_t)b->base;
+	if ((size_t)old < (size_t)b->base || off + oldsz != b->len) return 0;
+	if (newsz > b->cap - off) return 0;
+	arena_note_peak(a);
+	b->len = off + newsz;
+	return 1;
+}
+
+static void arena_reset(ArenaAllocator *a) {
+	ArenaBlock *keep = 0;
+	arena_note_peak(a);
+	size_t peak = a->peak;
+	// the dedicated blocks go in front of the chain, so the oldest block of the
+	// chain is still the one without 'prev'
+	if (a->large_blocks) {
+		ArenaBlock *oldest = a->large_blocks;
+		while (oldest->prev) oldest = oldest->prev;
+		oldest->prev = a->last_block;
+		a->last_block = a->large_blocks;
+		a->large_blocks = 0;
+	}
+	a->used = 0;
+	a->peak = 0;
+	for (ArenaBlock *b = a->last_block; b; b = b->prev) {
+		switch (a->retention) {
+		case ARENA_RETAIN_FIRST:
+			if (!b->prev) keep = b;
+			break;
+		case ARENA_RETAIN_LARGEST:
+		case ARENA_RETAIN_HIGH_WATER:
+			if (!keep || b->cap > keep->cap) keep = b;
+			break;
+		default:
+			break;
+		}
+	}
+	// rounded up, so padding differences still fit in the block
+	size_t high_water = alloc_align_up(peak, a->block);
+	if (
+		a->retention == ARENA_RETAIN_HIGH_WATER &&
+		keep &&
+		(keep->cap < high_water || keep->prev || keep != a->last_block)
+	) keep = 0;
+	for (ArenaBlock *b = 0; a->last_block; a->last_block = b) {
+		b = a->last_block->prev;
+		if (a->last_block != keep) arena_release_block(a, a->last_block);
+	}
+	if (keep) {
+		arena_forget_partial(a, keep);
+		keep->prev = 0;
+		keep->len = 0;
+		a->last_block = keep;
+		return;
+	}
+	// a failure here only means the next allocation will grow the arena
+	if (a->retention == ARENA_RETAIN_HIGH_WATER && peak) {
+		if (!arena_grow(a, high_water)) a->last_block->len = 0;
+	}
+}
+
+static int arena_owns(ArenaAllocator *a, void *p) {
+	ArenaBlock *chains[] = { a->last_block, a->large_blocks };
+	if ((size_t)p - a->lo >= a->hi - a->lo) return 0;
+	for (size_t i = 0; i < sizeof(chains)/sizeof(chains[0]); i++) {
+		for (ArenaBlock *b = chains[i]; b; b = b->prev) {
+			if ((size_t)p - (size_t)b->base < b->cap) return 1;
+		}
+	}
+	return 0;
+}
+
 static void *arena_alloc_fn(Allocator *a, AllocatorOP op) {
 	ArenaAllocator *arena = (ArenaAllocator *)a->state;
 	switch (op.opcode) {
 	case ALLOC_ALLOC: {
 		size_t needed = op.data.alloc.size;
-		return arena_alloc(arena, needed);
+		return arena_alloc_aligned(arena, needed, op.data.alloc.align);
 	}
 	case ALLOC_FREE:
 		// free is not implemented for arena, but it is safe to call
@@ -59,43 +314,186 @@ static void *arena_alloc_fn(Allocator *a, AllocatorOP op) {
 		if (!arena) {
 			return 0;
 		}
-		for (ArenaBlock *b = 0; (b = arena->last_block->prev);) {
-			alloc_free(arena->backing, arena->last_block);
-			arena->last_block = b;
-		}
-		arena->last_block->len = 0;
+		arena_reset(arena);
 		return 0;
 	case ALLOC_REALLOC:
 		if (!arena) return 0;
 		void *newp = 0;
+		// the most recent allocation grows or shrinks in place
+		if (arena_resize_last(
+			arena,
+			op.data.realloc.old,
+			op.data.realloc.oldsz,
+			op.data.realloc.newsz
+		)) return op.data.realloc.old;
 		if (!(newp = arena_alloc(arena, op.data.realloc.newsz))) return 0;
-		memcpy(newp, op.data.realloc.old, op.data.realloc.oldsz);
+		memcpy(
+			newp,
+			op.data.realloc.old,
+			MIN(op.data.realloc.oldsz, op.data.realloc.newsz)
+		);
 		return newp;
+	case ALLOC_ALLOC_BATCH:
+		return arena_alloc_batch(
+			arena,
+			op.data.alloc_batch.size,
+			op.data.alloc_batch.count,
+			op.data.alloc_batch.out
+		);
+	case ALLOC_FREE_BATCH:
+		// as free, it is safe to call
+		return op.data.free_batch.ptrs;
+	case ALLOC_OWNS:
+		return arena && arena_owns(arena, op.data.owns.ptr) ? a : 0;
 	default:
 		return 0;
 	}
 }
 
+// a saved point of the arena, restoring it releases everything allocated
+// after the mark, blocks created after it are given back to the backing
+// allocator. marks can be nested, but restoring a mark invalidates the ones
+// taken after it
+typedef struct ArenaMark {
+	ArenaBlock *block;
+	ArenaBlock *large;
+	size_t len;
+} ArenaMark;
+
+static ArenaMark arena_mark(Allocator *a) {
+	ArenaAllocator *arena = (ArenaAllocator *)a->state;
+	ArenaMark m = {0};
+	if (!arena || !arena->last_block) return m;
+	m.large = arena->large_blocks;
+	m.block = arena->last_block;
+	m.len = arena->last_block->len;
+	return m;
+}
+
+static void arena_restore(Allocator *a, ArenaMark m) {
+	ArenaAllocator *arena = (ArenaAllocator *)a->state;
+	if (!arena || !arena->last_block) return;
+	arena_note_peak(arena);
+	for (
+		ArenaBlock *b = 0;
+		arena->last_block != m.block && (b = arena->last_block->prev);
+	) {
+		arena_release_block(arena, arena->last_block);
+		arena->last_block = b;
+	}
+	for (ArenaBlock *b = 0; arena->large_blocks != m.large; ) {
+		b = arena->large_blocks->prev;
+		arena_release_block(arena, arena->large_blocks);
+		arena->large_blocks = b;
+	}
+	// allocations made after the mark in the tails of older blocks are only
+	// given back by ALLOC_FREE_ALL
+	arena_forget_partial(arena, arena->last_block);
+	arena->used = 0;
+	for (ArenaBlock *b = arena->last_block->prev; b; b = b->prev) {
+		arena->used += b->len;
+	}
+	for (ArenaBlock *b = arena->large_blocks; b; b = b->prev) {
+		arena->used += b->len;
+	}
+	// a mark of an empty arena keeps the oldest block, as free all does
+	arena->last_block->len = m.block ? m.len : 0;
+}
+
+// bytes the arena holds from the backing allocator that can no longer be
+// allocated, the free space at the end of every block besides the last one and
+// the ones with a tail still in use
+static size_t arena_wasted_bytes(Allocator *a) {
+	ArenaAllocator *arena = (ArenaAllocator *)a->state;
+	size_t wasted = 0;
+	if (!arena) return 0;
+	for (ArenaBlock *b = arena->last_block; b; b = b->prev) {
+		if (b == arena->last_block) continue;
+		wasted += b->cap - b->len;
+	}
+	for (ArenaBlock *b = arena->large_blocks; b; b = b->prev) {
+		wasted += b->cap - b->len;
+	}
+	for (size_t i = 0; i < ARENA_PARTIAL_BLOCKS; i++) {
+		if (arena->partial[i])
+			wasted -= arena->partial[i]->cap - arena->partial[i]->len;
+	}
+	return wasted;
+}
+
+typedef struct ArenaStats {
+	size_t blocks; // held from the backing allocator, retained ones included
+	size_t committed_bytes; // capacity of those blocks
+	size_t used_bytes; // allocated since the last free all, with padding
+	size_t wasted_bytes; // as arena_wasted_bytes
+	size_t peak_bytes; // highest used_bytes since the last free all
+} ArenaStats;
+
+static void arena_stats(Allocator *a, ArenaStats *dest) {
+	ArenaAllocator *arena = (ArenaAllocator *)a->state;
+	*dest = (ArenaStats){0};
+	if (!arena) return;
+	ArenaBlock *chains[] = {
+		arena->last_block, arena->large_blocks, arena->free_blocks
+	};
+	for (size_t i = 0; i < sizeof(chains)/sizeof(chains[0]); i++) {
+		for (ArenaBlock *b = chains[i]; b; b = b->prev) {
+			dest->blocks++;
+			dest->committed_bytes += b->cap;
+		}
+	}
+	arena_note_peak(arena);
+	dest->used_bytes = arena_used(arena);
+	dest->wasted_bytes = arena_wasted_bytes(a);
+	dest->peak_bytes = arena->peak;
+}
+
 static int arena_init(Allocator *a, Allocator *backing) {
 	*a = (Allocator){0};
 	ArenaAllocator *arena = 0;
 	if(!(arena = alloc_new(backing, sizeof(ArenaAllocator)))) return -1;
 	*arena = (ArenaAllocator){0};
 	arena->backing = backing;
+	arena->block = MIN_ALLOC_BLOCK;
 	a->alloc_fn = &arena_alloc_fn;
 	a->state = arena;
 	return 0;
 }
 
+// sets what ALLOC_FREE_ALL keeps, 'retain_bytes' is only used by
+// ARENA_RETAIN_BYTES
+static void arena_set_retention(
+	Allocator *a, ArenaRetention retention, size_t retain_bytes
+) {
+	ArenaAllocator *arena = (ArenaAllocator *)a->state;
+	arena->retention = retention;
+	arena->retain_bytes = retain_bytes;
+}
+
+// 'size' is what a block asks of the backing allocator, its header included,
+// so a backing allocator that rounds requests up, like the huge page one,
+// gets them in the size it hands out. blocks are MIN_ALLOC_BLOCK by default
+static void arena_set_block_size(Allocator *a, size_t size) {
+	ArenaAllocator *arena = (ArenaAllocator *)a->state;
+	size = MAX(size, 2*sizeof(ArenaBlock));
+	arena->block = size - sizeof(ArenaBlock);
+}
+
 static int arena_destroy(Allocator *a) {
 	if (!a->state) return 0;
 	ArenaAllocator *arena = (ArenaAllocator *)a->state;
-	int i = 0;
-	for (ArenaBlock *b = 0; (b = arena->last_block->prev) ; i++) {
+	for (ArenaBlock *b = 0; arena->last_block; arena->last_block = b) {
+		b = arena->last_block->prev;
 		alloc_free(arena->backing, arena->last_block);
-		arena->last_block = b;
 	}
-	alloc_free(arena->backing, arena->last_block);
+	for (ArenaBlock *b = 0; arena->large_blocks; arena->large_blocks = b) {
+		b = arena->large_blocks->prev;
+		alloc_free(arena->backing, arena->large_blocks);
+	}
+	for (ArenaBlock *b = 0; arena->free_blocks; arena->free_blocks = b) {
+		b = arena->free_blocks->prev;
+		alloc_free(arena->backing, arena->free_blocks);
+	}
 	alloc_free(arena->backing, arena);
 	a->state = 0;
 	return 0;
@@ -0,0 +1,174 @@
+#ifndef BUDGET_ALLOCATOR_H
+#define BUDGET_ALLOCATOR_H
+
+#include <stdatomic.h>
+#include "allocator.h"
+
+// called once every time the bytes in use cross the soft limit, from the
+// thread whose allocation crossed it. it may free memory of the allocator
+typedef void (*BudgetCallback)(Allocator *a, size_t used, void *ctx);
+
+// every allocation is prefixed by its size, as in the stats allocator, so
+// frees and reallocs give back exactly what they took
+typedef struct BudgetHeader {
+	size_t size;
+	size_t offset;
+} BudgetHeader;
+
+// bounds the bytes allocated through it, allocations past the hard limit fail
+// without reaching the backing allocator. the bytes in use are reserved with
+// an atomic add before calling the backing allocator, so it is as thread safe
+// as the backing allocator
+typedef struct BudgetAllocator {
+	Allocator *backing;
+	Allocator *self;
+	size_t hard_limit;
+	size_t soft_limit;
+	BudgetCallback callback;
+	void *ctx;
+	_Atomic size_t used;
+	_Atomic int over_soft;
+} BudgetAllocator;
+
+// takes 'sz' bytes of the budget, fails past the hard limit
+static int budget_reserve(BudgetAllocator *b, size_t sz) {
+	size_t used = atomic_load_explicit(&b->used, memory_order_relaxed);
+	do {
+		if (sz > b->hard_limit - used) return -1;
+	} while (!atomic_compare_exchange_weak_explicit(
+		&b->used, &used, used + sz, memory_order_relaxed, memory_order_relaxed
+	));
+	used += sz;
+	if (
+		used > b->soft_limit &&
+		!atomic_exchange_explicit(&b->over_soft, 1, memory_order_relaxed) &&
+		b->callback
+	) b->callback(b->self, used, b->ctx);
+	return 0;
+}
+
+static void budget_unreserve(BudgetAllocator *b, size_t sz) {
+	size_t used = atomic_fetch_sub_explicit(
+		&b->used, sz, memory_order_relaxed
+	) - sz;
+	// the callback fires again on the next crossing
+	if (used <= b->soft_limit)
+		atomic_store_explicit(&b->over_soft, 0, memory_order_relaxed);
+}
+
+static void *budget_alloc_aligned(BudgetAllocator *b, size_t sz, size_t align) {
+	size_t hdrsz = MAX(sizeof(BudgetHeader), align);
+	unsigned char *raw = 0;
+	if (hdrsz + sz < sz || budget_reserve(b, sz)) return 0;
+	if (!(raw = alloc_new_aligned(b->backing, hdrsz + sz, align))) {
+		budget_unreserve(b, sz);
+		return 0;
+	}
+	BudgetHeader *h = (BudgetHeader *)(raw + hdrsz) - 1;
+	*h = (BudgetHeader){ .size = sz, .offset = hdrsz };
+	return h + 1;
+}
+
+static void budget_free(BudgetAllocator *b, void *p) {
+	if (!p) return;
+	BudgetHeader *h = (BudgetHeader *)p - 1;
+	size_t size = h->size;
+	alloc_free(b->backing, (unsigned char *)p - h->offset);
+	budget_unreserve(b, size);
+}
+
+static void *budget_realloc(
+	BudgetAllocator *b, void *old, size_t oldsz, size_t newsz
+) {
+	if (!old) return budget_alloc_aligned(b, newsz, 0);
+	BudgetHeader *h = (BudgetHeader *)old - 1;
+	size_t size = h->size;
+	void *p = 0;
+	// over aligned allocations can not keep their padding through a realloc
+	if (h->offset != sizeof(BudgetHeader)) {
+		if (!(p = budget_alloc_aligned(b, newsz, 0))) return 0;
+		memcpy(p, old, MIN(size, newsz));
+		budget_free(b, old);
+		return p;
+	}
+	if (sizeof(BudgetHeader) + newsz < newsz) return 0;
+	if (newsz > size && budget_reserve(b, newsz - size)) return 0;
+	if (!(h = alloc_realloc(
+		b->backing, h, sizeof(BudgetHeader) + oldsz, sizeof(BudgetHeader) + newsz
+	))) {
+		if (newsz > size) budget_unreserve(b, newsz - size);
+		return 0;
+	}
+	h->size = newsz;
+	if (newsz < size) budget_unreserve(b, size - newsz);
+	return h + 1;
+}
+
+static void *budget_alloc_fn(Allocator *a, AllocatorOP op) {
+	BudgetAllocator *b = a->state;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		return budget_alloc_aligned(b, op.data.alloc.size, op.data.alloc.align);
+	case ALLOC_FREE:
+		budget_free(b, op.data.free.ptr);
+		return 0;
+	case ALLOC_FREE_ALL:
+		alloc_free_all(b->backing);
+		atomic_store_explicit(&b->used, 0, memory_order_relaxed);
+		atomic_store_explicit(&b->over_soft, 0, memory_order_relaxed);
+		return 0;
+	case ALLOC_REALLOC:
+		return budget_realloc(
+			b, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		return alloc_owns(b->backing, op.data.owns.ptr) ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+// the limits count the bytes requested and not freed yet, not the headers or
+// what the backing allocator keeps for itself. over an arena, where frees give
+// nothing back, they bound the live bytes and not the memory committed, free
+// all resets them. 'b' is the state, owned by the caller and kept out of
+// 'backing' so free all can be forwarded to it. the Allocator must stay at
+// the same address, the callback receives it
+static int budget_allocator_init(
+	Allocator *a,
+	BudgetAllocator *b,
+	Allocator *backing,
+	size_t hard_limit,
+	size_t soft_limit
+) {
+	*b = (BudgetAllocator){
+		.backing = backing,
+		.self = a,
+		.hard_limit = hard_limit,
+		.soft_limit = MIN(soft_limit, hard_limit),
+	};
+	*a = (Allocator){.alloc_fn = &budget_alloc_fn, .state = b};
+	return 0;
+}
+
+static void budget_allocator_set_callback(
+	Allocator *a, BudgetCallback callback, void *ctx
+) {
+	BudgetAllocator *b = a->state;
+	b->callback = callback;
+	b->ctx = ctx;
+}
+
+static size_t budget_allocator_used(Allocator *a) {
+	BudgetAllocator *b = a->state;
+	return atomic_load_explicit(&b->used, memory_order_relaxed);
+}
+
+// allocations not freed yet are left in 'backing'
+static void budget_allocator_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &budget_alloc_fn) return;
+	*(BudgetAllocator *)a->state = (BudgetAllocator){0};
+	*a = (Allocator){0};
+}
+
+#endif // BUDGET_ALLOCATOR_H
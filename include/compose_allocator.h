@@ -0,0 +1,282 @@
+#ifndef COMPOSE_ALLOCATOR_H
+#define COMPOSE_ALLOCATOR_H
+
+#include "allocator.h"
+
+// allocators built out of other allocators. reallocs of the segregator and the
+// bucketizer are routed by their old size, frees and the fallback allocator
+// with ALLOC_OWNS, a pointer no child claims goes to the last child, so
+// allocators that can not tell what they own, like malloc, must be the last
+// one. the children are not owned, destroying a composition leaves them alone
+
+// moves an allocation to 'to', used when a realloc changes of child
+static void *compose_move(
+	Allocator *from, Allocator *to, void *old, size_t oldsz, size_t newsz
+) {
+	void *p = 0;
+	if (!(p = alloc_new(to, newsz))) return 0;
+	if (old) {
+		memcpy(p, old, MIN(oldsz, newsz));
+		alloc_free(from, old);
+	}
+	return p;
+}
+
+////////////////////////////////////////
+// Fallback allocator
+
+// tries 'primary' first, a fixed buffer or an arena, and 'secondary' when it
+// fails
+typedef struct FallbackAllocator {
+	Allocator *backing;
+	Allocator *primary;
+	Allocator *secondary;
+} FallbackAllocator;
+
+static void *fallback_realloc(
+	FallbackAllocator *f, void *old, size_t oldsz, size_t newsz
+) {
+	void *p = 0;
+	if (!old && (p = alloc_new(f->primary, newsz))) return p;
+	if (!old || !alloc_owns(f->primary, old))
+		return alloc_realloc(f->secondary, old, oldsz, newsz);
+	if ((p = alloc_realloc(f->primary, old, oldsz, newsz))) return p;
+	return compose_move(f->primary, f->secondary, old, oldsz, newsz);
+}
+
+static void *fallback_alloc_fn(Allocator *a, AllocatorOP op) {
+	FallbackAllocator *f = a->state;
+	void *p = 0;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		if ((p = alloc_new_aligned(
+			f->primary, op.data.alloc.size, op.data.alloc.align
+		))) return p;
+		return alloc_new_aligned(
+			f->secondary, op.data.alloc.size, op.data.alloc.align
+		);
+	case ALLOC_FREE:
+		if (alloc_owns(f->primary, op.data.free.ptr))
+			alloc_free(f->primary, op.data.free.ptr);
+		else alloc_free(f->secondary, op.data.free.ptr);
+		return 0;
+	case ALLOC_FREE_ALL:
+		alloc_free_all(f->primary);
+		alloc_free_all(f->secondary);
+		return 0;
+	case ALLOC_REALLOC:
+		return fallback_realloc(
+			f, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		if (alloc_owns(f->primary, op.data.owns.ptr)) return a;
+		return alloc_owns(f->secondary, op.data.owns.ptr) ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+// the state is allocated from 'backing'
+static int fallback_allocator_init(
+	Allocator *a, Allocator *backing, Allocator *primary, Allocator *secondary
+) {
+	*a = (Allocator){0};
+	FallbackAllocator *f = 0;
+	if (!(f = alloc_new(backing, sizeof(FallbackAllocator)))) return -1;
+	*f = (FallbackAllocator){
+		.backing = backing, .primary = primary, .secondary = secondary
+	};
+	*a = (Allocator){.alloc_fn = &fallback_alloc_fn, .state = f};
+	return 0;
+}
+
+static void fallback_allocator_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &fallback_alloc_fn) return;
+	FallbackAllocator *f = a->state;
+	alloc_free(f->backing, f);
+	*a = (Allocator){0};
+}
+
+////////////////////////////////////////
+// Segregator allocator
+
+// sends allocations of up to 'threshold' bytes to 'small' and bigger ones to
+// 'large'
+typedef struct SegregatorAllocator {
+	Allocator *backing;
+	size_t threshold;
+	Allocator *small;
+	Allocator *large;
+} SegregatorAllocator;
+
+static Allocator *segregator_owner(SegregatorAllocator *s, void *p) {
+	return alloc_owns(s->small, p) ? s->small : s->large;
+}
+
+static void *segregator_realloc(
+	SegregatorAllocator *s, void *old, size_t oldsz, size_t newsz
+) {
+	Allocator *to = newsz <= s->threshold ? s->small : s->large;
+	Allocator *from = oldsz <= s->threshold ? s->small : s->large;
+	if (!old) from = to;
+	if (from == to) return alloc_realloc(to, old, oldsz, newsz);
+	return compose_move(from, to, old, oldsz, newsz);
+}
+
+static void *segregator_alloc_fn(Allocator *a, AllocatorOP op) {
+	SegregatorAllocator *s = a->state;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		return alloc_new_aligned(
+			op.data.alloc.size <= s->threshold ? s->small : s->large,
+			op.data.alloc.size,
+			op.data.alloc.align
+		);
+	case ALLOC_FREE:
+		if (op.data.free.ptr)
+			alloc_free(segregator_owner(s, op.data.free.ptr), op.data.free.ptr);
+		return 0;
+	case ALLOC_FREE_ALL:
+		alloc_free_all(s->small);
+		alloc_free_all(s->large);
+		return 0;
+	case ALLOC_REALLOC:
+		return segregator_realloc(
+			s, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		if (alloc_owns(s->small, op.data.owns.ptr)) return a;
+		return alloc_owns(s->large, op.data.owns.ptr) ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+// the state is allocated from 'backing'
+static int segregator_allocator_init(
+	Allocator *a,
+	Allocator *backing,
+	size_t threshold,
+	Allocator *small,
+	Allocator *large
+) {
+	*a = (Allocator){0};
+	SegregatorAllocator *s = 0;
+	if (!(s = alloc_new(backing, sizeof(SegregatorAllocator)))) return -1;
+	*s = (SegregatorAllocator){
+		.backing = backing,
+		.threshold = threshold,
+		.small = small,
+		.large = large,
+	};
+	*a = (Allocator){.alloc_fn = &segregator_alloc_fn, .state = s};
+	return 0;
+}
+
+static void segregator_allocator_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &segregator_alloc_fn) return;
+	SegregatorAllocator *s = a->state;
+	alloc_free(s->backing, s);
+	*a = (Allocator){0};
+}
+
+////////////////////////////////////////
+// Bucketizer allocator
+
+// child i takes the allocations of up to limits[i] bytes that did not fit the
+// previous children, 'limits' must be ascending. allocations bigger than the
+// last limit fail, use (size_t)-1 as the last limit to take every size
+typedef struct BucketizerAllocator {
+	Allocator *backing;
+	size_t n;
+	size_t *limits;
+	Allocator **children;
+} BucketizerAllocator;
+
+static Allocator *bucketizer_for_size(BucketizerAllocator *b, size_t sz) {
+	for (size_t i = 0; i < b->n; i++) {
+		if (sz <= b->limits[i]) return b->children[i];
+	}
+	return 0;
+}
+
+static Allocator *bucketizer_owner(BucketizerAllocator *b, void *p) {
+	for (size_t i = 0; i + 1 < b->n; i++) {
+		if (alloc_owns(b->children[i], p)) return b->children[i];
+	}
+	return b->children[b->n-1];
+}
+
+static void *bucketizer_realloc(
+	BucketizerAllocator *b, void *old, size_t oldsz, size_t newsz
+) {
+	Allocator *to = 0, *from = 0;
+	if (!(to = bucketizer_for_size(b, newsz))) return 0;
+	if (!old) from = to;
+	else if (!(from = bucketizer_for_size(b, oldsz)))
+		from = bucketizer_owner(b, old);
+	if (from == to) return alloc_realloc(to, old, oldsz, newsz);
+	return compose_move(from, to, old, oldsz, newsz);
+}
+
+static void *bucketizer_alloc_fn(Allocator *a, AllocatorOP op) {
+	BucketizerAllocator *b = a->state;
+	Allocator *child = 0;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		if (!(child = bucketizer_for_size(b, op.data.alloc.size))) return 0;
+		return alloc_new_aligned(child, op.data.alloc.size, op.data.alloc.align);
+	case ALLOC_FREE:
+		if (op.data.free.ptr)
+			alloc_free(bucketizer_owner(b, op.data.free.ptr), op.data.free.ptr);
+		return 0;
+	case ALLOC_FREE_ALL:
+		for (size_t i = 0; i < b->n; i++) alloc_free_all(b->children[i]);
+		return 0;
+	case ALLOC_REALLOC:
+		return bucketizer_realloc(
+			b, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		for (size_t i = 0; i < b->n; i++) {
+			if (alloc_owns(b->children[i], op.data.owns.ptr)) return a;
+		}
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+// 'limits' and 'children' are copied, the state is allocated from 'backing'
+static int bucketizer_allocator_init(
+	Allocator *a,
+	Allocator *backing,
+	size_t n,
+	const size_t *limits,
+	Allocator **children
+) {
+	*a = (Allocator){0};
+	BucketizerAllocator *b = 0;
+	size_t sz = sizeof(BucketizerAllocator) +
+		n*(sizeof(size_t) + sizeof(Allocator *));
+	if (!n || !(b = alloc_new(backing, sz))) return -1;
+	*b = (BucketizerAllocator){
+		.backing = backing,
+		.n = n,
+		.limits = (size_t *)(b + 1),
+	};
+	b->children = (Allocator **)(b->limits + n);
+	memcpy(b->limits, limits, n*sizeof(size_t));
+	memcpy(b->children, children, n*sizeof(Allocator *));
+	*a = (Allocator){.alloc_fn = &bucketizer_alloc_fn, .state = b};
+	return 0;
+}
+
+static void bucketizer_allocator_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &bucketizer_alloc_fn) return;
+	BucketizerAllocator *b = a->state;
+	alloc_free(b->backing, b);
+	*a = (Allocator){0};
+}
+
+#endif // COMPOSE_ALLOCATOR_H
@@ -0,0 +1,157 @@
+#ifndef CONCURRENT_ARENA_ALLOCATOR_H
+#define CONCURRENT_ARENA_ALLOCATOR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "allocator.h"
+
+typedef struct ConcurrentArenaBlock {
+	struct ConcurrentArenaBlock *prev;
+	unsigned char *base;
+	size_t cap;
+	// may go past cap when threads race for the end of the block
+	_Atomic size_t len;
+} ConcurrentArenaBlock;
+
+// an arena many threads can allocate from at the same time, space is reserved
+// with an atomic add on the block length and only growing takes the lock.
+// ALLOC_FREE_ALL and destroy must only be called when no thread is allocating
+typedef struct ConcurrentArenaAllocator {
+	Allocator *backing;
+	_Atomic(ConcurrentArenaBlock *) last_block;
+	pthread_mutex_t lock;
+} ConcurrentArenaAllocator;
+
+// called with the lock held. the block is published with the first 'need'
+// bytes already reserved and their address is returned, so the thread that
+// grows the arena can not lose its space to the others and grow it again
+static void *concurrent_arena_grow(ConcurrentArenaAllocator *a, size_t need) {
+	size_t blocksz = sizeof(ConcurrentArenaBlock);
+	size_t datasz = MAX(need, MIN_ALLOC_BLOCK);
+	unsigned char *allocp = 0;
+	ConcurrentArenaBlock *b = 0;
+	//
+	allocp = alloc_new(a->backing, blocksz + datasz + ALLOC_DEFAULT_ALIGN);
+	if (!allocp) return 0;
+	b = (ConcurrentArenaBlock *)allocp;
+	b->prev = atomic_load_explicit(&a->last_block, memory_order_relaxed);
+	b->base = (unsigned char *)alloc_align_up(
+		(size_t)(allocp + blocksz), ALLOC_DEFAULT_ALIGN
+	);
+	b->cap = datasz;
+	atomic_init(&b->len, need);
+	atomic_store_explicit(&a->last_block, b, memory_order_release);
+	return b->base;
+}
+
+static void *concurrent_arena_alloc_aligned(
+	ConcurrentArenaAllocator *a, size_t sz, size_t align
+) {
+	if (align < ALLOC_DEFAULT_ALIGN) align = ALLOC_DEFAULT_ALIGN;
+	// every reservation keeps the block length aligned to ALLOC_DEFAULT_ALIGN,
+	// bigger alignments reserve room for the padding
+	size_t need = alloc_align_up(sz, ALLOC_DEFAULT_ALIGN) +
+		(align - ALLOC_DEFAULT_ALIGN);
+	ConcurrentArenaBlock *b = 0;
+	unsigned char *p = 0;
+	size_t off = 0;
+	for (;;) {
+		b = atomic_load_explicit(&a->last_block, memory_order_acquire);
+		if (b) {
+			off = atomic_fetch_add_explicit(&b->len, need, memory_order_relaxed);
+			if (off <= b->cap && b->cap - off >= need)
+				return (void *)alloc_align_up((size_t)(b->base + off), align);
+		}
+		pthread_mutex_lock(&a->lock);
+		// another thread may have grown the arena while we waited
+		if (atomic_load_explicit(&a->last_block, memory_order_relaxed) != b) {
+			pthread_mutex_unlock(&a->lock);
+			continue;
+		}
+		p = concurrent_arena_grow(a, need);
+		pthread_mutex_unlock(&a->lock);
+		return p ? (void *)alloc_align_up((size_t)p, align) : 0;
+	}
+}
+
+static void concurrent_arena_release(ConcurrentArenaAllocator *a, int keep) {
+	ConcurrentArenaBlock *b =
+		atomic_load_explicit(&a->last_block, memory_order_acquire);
+	for (ConcurrentArenaBlock *prev = 0; b; b = prev) {
+		if (keep && !b->prev) break;
+		prev = b->prev;
+		alloc_free(a->backing, b);
+	}
+	// the oldest block is kept for reuse, as in the arena allocator
+	if (b) atomic_store_explicit(&b->len, 0, memory_order_relaxed);
+	atomic_store_explicit(&a->last_block, b, memory_order_release);
+}
+
+static int concurrent_arena_owns(ConcurrentArenaAllocator *a, void *p) {
+	ConcurrentArenaBlock *b =
+		atomic_load_explicit(&a->last_block, memory_order_acquire);
+	for (; b; b = b->prev) {
+		if ((size_t)p - (size_t)b->base < b->cap) return 1;
+	}
+	return 0;
+}
+
+static void *concurrent_arena_alloc_fn(Allocator *a, AllocatorOP op) {
+	ConcurrentArenaAllocator *arena = (ConcurrentArenaAllocator *)a->state;
+	void *p = 0;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		return concurrent_arena_alloc_aligned(
+			arena, op.data.alloc.size, op.data.alloc.align
+		);
+	case ALLOC_FREE:
+		// free is not implemented for arena, but it is safe to call
+		return 0;
+	case ALLOC_FREE_ALL:
+		concurrent_arena_release(arena, 1);
+		return 0;
+	case ALLOC_REALLOC:
+		if (!(p = concurrent_arena_alloc_aligned(
+			arena, op.data.realloc.newsz, ALLOC_DEFAULT_ALIGN
+		))) return 0;
+		if (op.data.realloc.old) memcpy(
+			p,
+			op.data.realloc.old,
+			MIN(op.data.realloc.oldsz, op.data.realloc.newsz)
+		);
+		return p;
+	case ALLOC_OWNS:
+		return concurrent_arena_owns(arena, op.data.owns.ptr) ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+static int concurrent_arena_init(Allocator *a, Allocator *backing) {
+	*a = (Allocator){0};
+	ConcurrentArenaAllocator *arena = 0;
+	if (!(arena = alloc_new(backing, sizeof(ConcurrentArenaAllocator))))
+		return -1;
+	*arena = (ConcurrentArenaAllocator){0};
+	arena->backing = backing;
+	atomic_init(&arena->last_block, 0);
+	if (pthread_mutex_init(&arena->lock, 0)) {
+		alloc_free(backing, arena);
+		return -1;
+	}
+	a->alloc_fn = &concurrent_arena_alloc_fn;
+	a->state = arena;
+	return 0;
+}
+
+static int concurrent_arena_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &concurrent_arena_alloc_fn) return 0;
+	ConcurrentArenaAllocator *arena = (ConcurrentArenaAllocator *)a->state;
+	concurrent_arena_release(arena, 0);
+	pthread_mutex_destroy(&arena->lock);
+	alloc_free(arena->backing, arena);
+	*a = (Allocator){0};
+	return 0;
+}
+
+#endif // CONCURRENT_ARENA_ALLOCATOR_H
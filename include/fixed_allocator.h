@@ -0,0 +1,93 @@
+#ifndef FIXED_ALLOCATOR_H
+#define FIXED_ALLOCATOR_H
+
+#include "allocator.h"
+
+// bump allocator over a buffer the caller owns, usually on the stack. it never
+// grows, allocations that do not fit fail, which makes it the primary of a
+// fallback allocator. the state lives at the beginning of the buffer
+typedef struct FixedAllocator {
+	unsigned char *base;
+	size_t cap;
+	size_t len;
+	size_t last; // offset of the most recent allocation, cap when there is none
+} FixedAllocator;
+
+static void *fixed_alloc_aligned(FixedAllocator *f, size_t sz, size_t align) {
+	if (!align) align = ALLOC_DEFAULT_ALIGN;
+	size_t off = alloc_align_up((size_t)f->base + f->len, align) -
+		(size_t)f->base;
+	if (off > f->cap || sz > f->cap - off) return 0;
+	f->last = off;
+	f->len = off + sz;
+	return f->base + off;
+}
+
+static void *fixed_realloc(
+	FixedAllocator *f, void *old, size_t oldsz, size_t newsz
+) {
+	void *p = 0;
+	// the most recent allocation grows or shrinks in place, the others only
+	// shrink
+	if (old && old == f->base + f->last) {
+		if (newsz > f->cap - f->last) return 0;
+		f->len = f->last + newsz;
+		return old;
+	}
+	if (old && newsz <= oldsz) return old;
+	if (!(p = fixed_alloc_aligned(f, newsz, ALLOC_DEFAULT_ALIGN))) return 0;
+	if (old) memcpy(p, old, MIN(oldsz, newsz));
+	return p;
+}
+
+static size_t fixed_header_size(void) {
+	return alloc_align_up(sizeof(FixedAllocator), ALLOC_DEFAULT_ALIGN);
+}
+
+static void *fixed_alloc_fn(Allocator *a, AllocatorOP op) {
+	FixedAllocator *f = a->state;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		return fixed_alloc_aligned(f, op.data.alloc.size, op.data.alloc.align);
+	case ALLOC_FREE:
+		// only the most recent allocation gives its space back, once
+		if (op.data.free.ptr && op.data.free.ptr == f->base + f->last) {
+			f->len = f->last;
+			f->last = f->cap;
+		}
+		return 0;
+	case ALLOC_FREE_ALL:
+		f->len = fixed_header_size();
+		f->last = f->cap;
+		return 0;
+	case ALLOC_REALLOC:
+		return fixed_realloc(
+			f, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		return (size_t)op.data.owns.ptr - (size_t)f->base < f->cap ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+// 'buf' must outlive the allocator, nothing has to be destroyed
+static int fixed_allocator_init(Allocator *a, void *buf, size_t size) {
+	*a = (Allocator){0};
+	unsigned char *base = (unsigned char *)alloc_align_up(
+		(size_t)buf, ALLOC_DEFAULT_ALIGN
+	);
+	size_t pad = base - (unsigned char *)buf;
+	if (size < pad + fixed_header_size()) return -1;
+	FixedAllocator *f = (FixedAllocator *)base;
+	*f = (FixedAllocator){
+		.base = base,
+		.cap = size - pad,
+		.len = fixed_header_size(),
+		.last = size - pad,
+	};
+	*a = (Allocator){.alloc_fn = &fixed_alloc_fn, .state = f};
+	return 0;
+}
+
+#endif // FIXED_ALLOCATOR_H
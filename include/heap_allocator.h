@@ -17,7 +17,9 @@ static void *heap_alloc_fn(Allocator *a, AllocatorOP op) {
 	void *p = 0;
 	switch (op.opcode) {
 	case ALLOC_ALLOC:
-		p = alloc_new(h->backing, op.data.alloc.size);
+		p = alloc_new_aligned(
+			h->backing, op.data.alloc.size, op.data.alloc.align
+		);
 		if (!p) return 0;
 		return p;
 	case ALLOC_FREE:
@@ -34,6 +36,21 @@ static void *heap_alloc_fn(Allocator *a, AllocatorOP op) {
 		);
 		if (!p) return 0;
 		return p;
+	case ALLOC_ALLOC_BATCH:
+		if (alloc_new_batch(
+			h->backing,
+			op.data.alloc_batch.size,
+			op.data.alloc_batch.count,
+			op.data.alloc_batch.out
+		)) return ALLOC_BATCH_FAILED;
+		return op.data.alloc_batch.out;
+	case ALLOC_FREE_BATCH:
+		alloc_free_batch(
+			h->backing, op.data.free_batch.ptrs, op.data.free_batch.count
+		);
+		return op.data.free_batch.ptrs;
+	case ALLOC_OWNS:
+		return alloc_owns(h->backing, op.data.owns.ptr) ? a : 0;
 	default:
 		return 0;
 	}
@@ -14,26 +14,239 @@ typedef struct HeapAllocation {
 	const char *file;
 	int line;
 	unsigned char freed;
+	size_t site; // index in 'sites'
+	size_t next_free; // idx+1 of the next record to reuse when sampling
 } HeapAllocation;
 
+// allocations aggregated by call site
+typedef struct HeapAllocationSite {
+	const char *file;
+	int line;
+	size_t alloc_bytes;
+	size_t n_allocs;
+	size_t live_bytes;
+	size_t n_live;
+} HeapAllocationSite;
+
+typedef enum HeapProfileMetric {
+	HEAP_PROFILE_LIVE_BYTES,
+	HEAP_PROFILE_ALLOC_BYTES,
+	HEAP_PROFILE_ALLOCS,
+} HeapProfileMetric;
+
 typedef struct {
 	size_t alloc_bytes;
 	size_t n_allocs;
 	size_t leak_bytes;
 	size_t n_leaks;
+	size_t sample_rate; // when not 0 the figures above are estimates
 	Slice allocs; // HeapAllocation
+	Slice sites; // HeapAllocationSite
 } HeapAllocatorReport ;
 
+// open addressing slot, maps a pointer to its record in 'allocs'
+typedef struct HeapAllocationSlot {
+	void *ptr;
+	size_t idx;
+} HeapAllocationSlot;
+
 typedef struct HeapDebugAllocator {
 	Allocator *backing;
 	size_t alloc_tot;
 	size_t n_allocs;
 	Allocator arena;
+	// HeapAllocation, every record ever made. when sampling the records of
+	// freed pointers are reused, starting from 'free_records', idx+1 or 0
 	Slice allocs;
+	size_t free_records;
+	HeapAllocationSlot *slots; // index of 'allocs' by pointer, in 'arena'
+	size_t slots_cap; // power of two
+	size_t slots_len;
+	Slice sites; // HeapAllocationSite
+	size_t *site_slots; // index of 'sites' by file and line, idx+1 or 0
+	size_t site_slots_cap; // power of two
+	size_t sample_rate; // track 1 in 'sample_rate' allocations, 0 tracks all
+	size_t sample_countdown;
+	size_t sample_seed;
 } HeapDebugAllocator;
 
-static int heap_allocation_cmp_ptr(void *ctx, void *test) {
-	return (int)(((size_t)ctx) == (size_t)((HeapAllocation *)test)->ptr);
+// -ln(u) of u = x/2^53 in (0, 1], without libm. with u = m*2^-k and m in
+// [1, 2), ln(m) = 2*atanh((m-1)/(m+1)) and the series converges fast
+static double heap_debug_neg_log(size_t x) {
+	int e = (int)(sizeof(long long)*8 - 1) - __builtin_clzll(x);
+	double m = (double)x / (double)((size_t)1 << e);
+	double t = (m - 1)/(m + 1), t2 = t*t;
+	double ln_m = 2*t*(1 + t2*(1.0/3 + t2*(1.0/5 + t2*(1.0/7 + t2/9))));
+	return (53 - e)*0.6931471805599453 - ln_m;
+}
+
+// exponential interval with mean 'sample_rate', so every allocation has the
+// same chance to be sampled no matter how long ago the last sample was, and
+// the sampled allocations do not follow periodic allocation patterns
+static size_t heap_debug_sample_interval(HeapDebugAllocator *h) {
+	size_t x = h->sample_seed;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	h->sample_seed = x;
+	return 1 + (size_t)(heap_debug_neg_log((x >> 11) + 1) * h->sample_rate);
+}
+
+#ifndef HEAP_DEBUG_MIN_SLOTS
+#define HEAP_DEBUG_MIN_SLOTS 1024
+#endif
+
+static size_t heap_debug_slot(HeapDebugAllocator *h, void *ptr) {
+	size_t x = (size_t)ptr;
+	x ^= x >> 33;
+	x *= (size_t)0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	return x & (h->slots_cap-1);
+}
+
+static HeapAllocation *heap_debug_find(HeapDebugAllocator *h, void *ptr) {
+	if (!h->slots_cap || !ptr) return 0;
+	for (size_t i = heap_debug_slot(h, ptr);; i = (i+1) & (h->slots_cap-1)) {
+		if (!h->slots[i].ptr) return 0;
+		if (h->slots[i].ptr == ptr)
+			return (HeapAllocation *)h->allocs.base + h->slots[i].idx;
+	}
+}
+
+static void heap_debug_index_put(HeapDebugAllocator *h, void *ptr, size_t idx);
+
+static int heap_debug_index_grow(HeapDebugAllocator *h) {
+	HeapAllocationSlot *old = h->slots;
+	size_t oldcap = h->slots_cap;
+	size_t cap = MAX(oldcap*2, HEAP_DEBUG_MIN_SLOTS);
+	HeapAllocationSlot *slots = 0;
+	// the old table stays in the arena as dead space, growth is geometric
+	if (!(slots = alloc_new(&h->arena, cap*sizeof(HeapAllocationSlot))))
+		return -1;
+	memset(slots, 0, cap*sizeof(HeapAllocationSlot));
+	h->slots = slots;
+	h->slots_cap = cap;
+	h->slots_len = 0;
+	for (size_t i = 0; i < oldcap; i++) {
+		if (old[i].ptr) heap_debug_index_put(h, old[i].ptr, old[i].idx);
+	}
+	return 0;
+}
+
+// makes room for one more pointer, so the next put can not fail
+static int heap_debug_index_reserve(HeapDebugAllocator *h) {
+	if ((h->slots_len+1)*2 <= h->slots_cap) return 0;
+	return heap_debug_index_grow(h);
+}
+
+// maps 'ptr' to the record 'idx', replacing the previous mapping of 'ptr'.
+// there must be room for it
+static void heap_debug_index_put(HeapDebugAllocator *h, void *ptr, size_t idx) {
+	size_t i = heap_debug_slot(h, ptr);
+	for (; h->slots[i].ptr; i = (i+1) & (h->slots_cap-1)) {
+		if (h->slots[i].ptr != ptr) continue;
+		h->slots[i].idx = idx;
+		return;
+	}
+	h->slots[i] = (HeapAllocationSlot){ .ptr = ptr, .idx = idx };
+	h->slots_len++;
+}
+
+#ifndef HEAP_DEBUG_MIN_SITE_SLOTS
+#define HEAP_DEBUG_MIN_SITE_SLOTS 64
+#endif
+
+static size_t heap_debug_site_slot(
+	HeapDebugAllocator *h, const char *file, int line
+) {
+	size_t x = (size_t)file ^ ((size_t)line << 32) ^ (size_t)line;
+	x ^= x >> 33;
+	x *= (size_t)0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	return x & (h->site_slots_cap-1);
+}
+
+static int heap_debug_site_slots_grow(HeapDebugAllocator *h) {
+	size_t cap = MAX(h->site_slots_cap*2, HEAP_DEBUG_MIN_SITE_SLOTS);
+	size_t *slots = 0;
+	HeapAllocationSite *sites = (HeapAllocationSite *)h->sites.base;
+	if (!(slots = alloc_new(&h->arena, cap*sizeof(size_t)))) return -1;
+	memset(slots, 0, cap*sizeof(size_t));
+	h->site_slots = slots;
+	h->site_slots_cap = cap;
+	for (size_t i = 0; i < slice_len(&h->sites); i++) {
+		size_t j = heap_debug_site_slot(h, sites[i].file, sites[i].line);
+		for (; slots[j]; j = (j+1) & (cap-1));
+		slots[j] = i+1;
+	}
+	return 0;
+}
+
+// index in 'sites' of the call site, it is added on the first allocation
+static int heap_debug_site(
+	HeapDebugAllocator *h, const char *file, int line, size_t *dest
+) {
+	if (
+		(slice_len(&h->sites)+1)*2 > h->site_slots_cap &&
+		heap_debug_site_slots_grow(h)
+	) return -1;
+	size_t i = heap_debug_site_slot(h, file, line);
+	HeapAllocationSite *site = 0;
+	for (; h->site_slots[i]; i = (i+1) & (h->site_slots_cap-1)) {
+		site = (HeapAllocationSite *)h->sites.base + h->site_slots[i]-1;
+		if (site->file != file || site->line != line) continue;
+		*dest = h->site_slots[i]-1;
+		return 0;
+	}
+	HeapAllocationSite new_site = { .file = file, .line = line };
+	if (slice_append(&h->sites, &new_site)) return -1;
+	*dest = slice_len(&h->sites)-1;
+	h->site_slots[i] = *dest+1;
+	return 0;
+}
+
+// removes 'ptr' shifting back the slots of its probe sequence, so lookups
+// never need tombstones
+static void heap_debug_unindex(HeapDebugAllocator *h, void *ptr) {
+	if (!h->slots_cap) return;
+	size_t mask = h->slots_cap-1;
+	size_t i = heap_debug_slot(h, ptr);
+	for (; h->slots[i].ptr != ptr; i = (i+1) & mask) {
+		if (!h->slots[i].ptr) return;
+	}
+	for (size_t j = (i+1) & mask; h->slots[j].ptr; j = (j+1) & mask) {
+		size_t home = heap_debug_slot(h, h->slots[j].ptr);
+		// the slot can only move back if 'i' is between its home and 'j'
+		if (((j - home) & mask) < ((j - i) & mask)) continue;
+		h->slots[i] = h->slots[j];
+		i = j;
+	}
+	h->slots[i] = (HeapAllocationSlot){0};
+	h->slots_len--;
+}
+
+// stores and indexes the record of a new allocation, nothing is counted yet
+static int heap_debug_record(HeapDebugAllocator *h, HeapAllocation *ha) {
+	HeapAllocation *r = 0;
+	size_t idx = 0;
+	if (heap_debug_site(h, ha->file, ha->line, &ha->site)) return -1;
+	if (heap_debug_index_reserve(h)) return -1;
+	// the pointer may have been handed out and freed before
+	if ((r = heap_debug_find(h, ha->ptr))) {
+		*r = *ha;
+		return 0;
+	}
+	if (h->free_records) {
+		idx = h->free_records-1;
+		r = (HeapAllocation *)h->allocs.base + idx;
+		h->free_records = r->next_free;
+		*r = *ha;
+	} else {
+		if (slice_append(&h->allocs, ha)) return -1;
+		idx = slice_len(&h->allocs)-1;
+	}
+	heap_debug_index_put(h, ha->ptr, idx);
+	return 0;
 }
 
 static void *heap_debug_alloc_fn(Allocator *a, AllocatorOP op) {
@@ -41,42 +254,52 @@ static void *heap_debug_alloc_fn(Allocator *a, AllocatorOP op) {
 	void *p = 0;
 	HeapAllocation ha = {0};
 	HeapAllocation *haptr = 0;
+	HeapAllocationSite *site = 0;
 	switch (op.opcode) {
 	case ALLOC_ALLOC:
-		p = _alloc_new(
-			h->backing, op.data.alloc.size, op.data.alloc.file, op.data.alloc.line
+		p = _alloc_new_aligned(
+			h->backing,
+			op.data.alloc.size,
+			op.data.alloc.align,
+			op.data.alloc.file,
+			op.data.alloc.line
 		);
 		if (!p) return 0;
-		h->alloc_tot += op.data.alloc.size;
-		h->n_allocs++;
+		// untracked allocations only pay the countdown
+		if (h->sample_rate && --h->sample_countdown) return p;
+		if (h->sample_rate) h->sample_countdown = heap_debug_sample_interval(h);
 		ha = (HeapAllocation){
 			.ptr = p,
 			.size = op.data.alloc.size,
 			.file = op.data.alloc.file,
 			.line = op.data.alloc.line,
 		};
-		if (
-			slice_find_ptr(
-				&h->allocs,
-				(void*)op.data.free.ptr,
-				heap_allocation_cmp_ptr,
-				(void *)&haptr
-			)
-		) {
-			*haptr = ha;
-			return p;
+		// an allocation that can not be tracked fails, as if it was not there
+		if (heap_debug_record(h, &ha)) {
+			_alloc_free(h->backing, p, op.data.alloc.file, op.data.alloc.line);
+			return 0;
 		}
-		assert(!slice_append(&h->allocs, &ha));
+		h->alloc_tot += ha.size;
+		h->n_allocs++;
+		site = (HeapAllocationSite *)h->sites.base + ha.site;
+		site->alloc_bytes += ha.size;
+		site->n_allocs++;
+		site->live_bytes += ha.size;
+		site->n_live++;
 		return p;
 	case ALLOC_FREE:
+		// when sampling, pointers that are not tracked were not sampled, so
+		// bad and double frees are not detected
 		if (
-			!slice_find_ptr(
-				&h->allocs,
-				(void*)op.data.free.ptr,
-				heap_allocation_cmp_ptr,
-				(void *)&haptr
-			)
+			h->sample_rate &&
+			(!(haptr = heap_debug_find(h, op.data.free.ptr)) || haptr->freed)
 		) {
+			_alloc_free(
+				h->backing, op.data.free.ptr, op.data.free.file, op.data.free.line
+			);
+			return 0;
+		}
+		if (!(haptr = heap_debug_find(h, op.data.free.ptr))) {
 			printf(
 				"%s:%d freeing pointer %p that is not allocated\n",
 				op.data.free.file,
@@ -102,18 +325,30 @@ static void *heap_debug_alloc_fn(Allocator *a, AllocatorOP op) {
 			h->backing, op.data.free.ptr, op.data.free.file, op.data.free.line
 		);
 		haptr->freed = 1;
+		site = (HeapAllocationSite *)h->sites.base + haptr->site;
+		site->live_bytes -= haptr->size;
+		site->n_live--;
+		if (!h->sample_rate) return 0;
+		// the record is reused, every record is kept to catch double frees
+		// only when all the allocations are tracked
+		heap_debug_unindex(h, op.data.free.ptr);
+		haptr->next_free = h->free_records;
+		h->free_records = haptr - (HeapAllocation *)h->allocs.base + 1;
 		return 0;
 	case ALLOC_FREE_ALL:
 		return 0;
 	case ALLOC_REALLOC:
-		if (
-			!slice_find_ptr(
-				&h->allocs,
-				(void*)op.data.realloc.old,
-				heap_allocation_cmp_ptr,
-				(void *)&haptr
-			)
-		) {
+		if (h->sample_rate && !heap_debug_find(h, op.data.realloc.old)) {
+			return _alloc_realloc(
+				h->backing,
+				op.data.realloc.old,
+				op.data.realloc.oldsz,
+				op.data.realloc.newsz,
+				op.data.realloc.file,
+				op.data.realloc.line
+			);
+		}
+		if (!(haptr = heap_debug_find(h, op.data.realloc.old))) {
 			printf(
 				"%s:%d attempt to realloc pointer %p that is not allocated\n",
 				op.data.realloc.file,
@@ -135,6 +370,8 @@ static void *heap_debug_alloc_fn(Allocator *a, AllocatorOP op) {
 			fflush(stdout);
 			assert(0);
 		}
+		// a moved pointer is indexed again, which must not fail after the move
+		if (heap_debug_index_reserve(h)) return 0;
 		p = _alloc_realloc(
 			h->backing,
 			op.data.realloc.old,
@@ -146,9 +383,25 @@ static void *heap_debug_alloc_fn(Allocator *a, AllocatorOP op) {
 		if (!p) return 0;
 		h->n_allocs++;
 		h->alloc_tot += (op.data.realloc.newsz-haptr->size);
+		site = (HeapAllocationSite *)h->sites.base + haptr->site;
+		site->alloc_bytes += (op.data.realloc.newsz-haptr->size);
+		site->n_allocs++;
+		site->live_bytes += (op.data.realloc.newsz-haptr->size);
 		haptr->ptr = p;
 		haptr->size = op.data.realloc.newsz;
+		if (p != op.data.realloc.old) {
+			size_t idx = haptr - (HeapAllocation *)h->allocs.base;
+			heap_debug_unindex(h, op.data.realloc.old);
+			heap_debug_index_put(h, p, idx);
+		}
 		return p;
+	case ALLOC_OWNS:
+		if ((haptr = heap_debug_find(h, op.data.owns.ptr)) && !haptr->freed)
+			return a;
+		// pointers that were not sampled are not tracked
+		if (h->sample_rate && alloc_owns(h->backing, op.data.owns.ptr))
+			return a;
+		return 0;
 	default:
 		return 0;
 	}
@@ -159,10 +412,15 @@ static int heap_debug_allocator_init(Allocator *a, Allocator *backing) {
 	if (!(h = alloc_new(backing, sizeof(HeapDebugAllocator)))) return 1;
 	*h = (HeapDebugAllocator){0};
 	h->backing = backing;
-	assert(!arena_init(&h->arena, backing));
+	if (arena_init(&h->arena, backing)) {
+		alloc_free(backing, h);
+		return 1;
+	}
 	Slice s = {0};
 	slice_init(&s, &h->arena, sizeof(HeapAllocation));
 	h->allocs = s;
+	slice_init(&s, &h->arena, sizeof(HeapAllocationSite));
+	h->sites = s;
 	*a = (Allocator){.alloc_fn = &heap_debug_alloc_fn, .state = h};
 	return 0;
 }
@@ -176,6 +434,15 @@ static void heap_debug_allocator_destroy(Allocator *a) {
 	*a = b;
 }
 
+// tracks about 1 in 'one_in_n' allocations, reports extrapolate from them.
+// 0 or 1 tracks every allocation
+static void heap_allocator_set_sampling(Allocator *a, size_t one_in_n) {
+	HeapDebugAllocator *h = a->state;
+	h->sample_rate = one_in_n > 1 ? one_in_n : 0;
+	if (!h->sample_seed) h->sample_seed = (size_t)h | 1;
+	if (h->sample_rate) h->sample_countdown = heap_debug_sample_interval(h);
+}
+
 static int heap_allocator_get_report(Allocator *a, HeapAllocatorReport *r) {
 	*r = (HeapAllocatorReport){0};
 	HeapDebugAllocator *h = a->state;
@@ -184,6 +451,7 @@ static int heap_allocator_get_report(Allocator *a, HeapAllocatorReport *r) {
 	r->alloc_bytes = h->alloc_tot;
 	r->n_allocs = h->n_allocs;
 	r->allocs = h->allocs;
+	r->sites = h->sites;
 	//
 	for (size_t i = 0; i < slice_len(&h->allocs); i++) {
 		slice_get(&h->allocs, i, &ha);
@@ -192,19 +460,34 @@ static int heap_allocator_get_report(Allocator *a, HeapAllocatorReport *r) {
 			r->n_leaks++; 
 		}
 	}
+	if (!(r->sample_rate = h->sample_rate)) return 0;
+	r->alloc_bytes *= h->sample_rate;
+	r->n_allocs *= h->sample_rate;
+	r->leak_bytes *= h->sample_rate;
+	r->n_leaks *= h->sample_rate;
 	return 0;
 }
 
 static void heap_allocator_report_print(HeapAllocatorReport *r) {
-	HeapAllocation ha = {0};
+	HeapAllocationSite site = {0};
+	size_t rate = r->sample_rate ? r->sample_rate : 1;
 	printf("########## HEAP ALLOCATOR REPORT BEGIN ##########\n");
 	if (bytes_is((void *)r, 0, sizeof(HeapAllocatorReport))) 
 		printf("empty report\n");
-	for (size_t i = 0; i < slice_len(&r->allocs); i++) {
-		slice_get(&r->allocs, i, &ha);
-		if (!ha.freed)
-			printf("LEAK: ptr %p allocated in %s:%d\n", ha.ptr, ha.file, ha.line);
+	// one line per call site, no matter how many times it leaked
+	for (size_t i = 0; i < slice_len(&r->sites); i++) {
+		slice_get(&r->sites, i, &site);
+		if (site.n_live) printf(
+			"LEAK: %lu pointers, %lu bytes allocated in %s:%d\n",
+			site.n_live * rate,
+			site.live_bytes * rate,
+			site.file,
+			site.line
+		);
 	}
+	if (r->sample_rate) printf(
+		"SAMPLING 1 IN %lu ALLOCATIONS, TOTALS ARE ESTIMATES\n", r->sample_rate
+	);
 	printf("TOTAL BYTES ALLOCATED: %lu\n", r->alloc_bytes);
 	printf("TOTAL ALLOCATIONS: %lu\n", r->n_allocs);
 	printf("TOTAL BYTES LEAKED: %lu\n", r->leak_bytes);
@@ -212,5 +495,52 @@ static void heap_allocator_report_print(HeapAllocatorReport *r) {
 	printf("########## HEAP ALLOCATOR REPORT END ##########\n");
 }
 
+static size_t heap_allocation_site_value(
+	HeapAllocationSite *site, HeapProfileMetric metric
+) {
+	switch (metric) {
+	case HEAP_PROFILE_LIVE_BYTES:
+		return site->live_bytes;
+	case HEAP_PROFILE_ALLOC_BYTES:
+		return site->alloc_bytes;
+	case HEAP_PROFILE_ALLOCS:
+		return site->n_allocs;
+	default:
+		return 0;
+	}
+}
+
+// writes one 'file:line value' line per call site, the collapsed stacks format
+// read by flamegraph.pl and speedscope. sites with a zero value are skipped
+static int64_t heap_allocator_profile_write(
+	HeapAllocatorReport *r, HeapProfileMetric metric, Writer *w
+) {
+	char buf[512] = {0};
+	HeapAllocationSite site = {0};
+	Slice line = {0}, reslice = {0};
+	int64_t tot = 0, n = 0;
+	size_t rate = r->sample_rate ? r->sample_rate : 1;
+	int len = 0;
+	//
+	for (size_t i = 0; i < slice_len(&r->sites); i++) {
+		slice_get(&r->sites, i, &site);
+		size_t value = heap_allocation_site_value(&site, metric) * rate;
+		if (!value) continue;
+		len = snprintf(
+			buf, sizeof(buf), "%s:%d %lu\n", site.file, site.line, value
+		);
+		if (len < 0 || (size_t)len >= sizeof(buf)) return -1;
+		line = (Slice){
+			.base = buf, .isz = 1, .len = len, .cap = len, .is_reslice = 1
+		};
+		for (int64_t off = 0; off < len; off += n) {
+			slice_reslice(&line, &reslice, off, len);
+			if ((n = writer_write(w, &reslice)) <= 0) return -2;
+		}
+		tot += len;
+	}
+	return tot;
+}
+
 #endif // HEAP_DEBUG_ALLOCATOR_H
 #endif // BLIB_DEBUG
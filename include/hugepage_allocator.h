@@ -0,0 +1,180 @@
+#ifndef HUGEPAGE_ALLOCATOR_H
+#define HUGEPAGE_ALLOCATOR_H
+
+#include "allocator.h" // first, it enables madvise in strict C11
+#include <sys/mman.h> // mmap / madvise / munmap
+#include <unistd.h> // sysconf
+
+#ifndef HUGEPAGE_SIZE
+#define HUGEPAGE_SIZE (((size_t)1) << 21)
+#endif
+
+// smaller requests go to the backing allocator, a mapping would waste most of
+// its huge page
+#ifndef HUGEPAGE_MIN_ALLOC
+#define HUGEPAGE_MIN_ALLOC (HUGEPAGE_SIZE/2)
+#endif
+
+typedef enum HugePageFlags {
+	// faults every page in when it is mapped, so the first touch does not stall
+	HUGEPAGE_POPULATE = 1,
+} HugePageFlags;
+
+// lives at the end of the page mapped right before the allocation
+typedef struct HugePageMapping {
+	struct HugePageMapping *prev;
+	struct HugePageMapping *next;
+	size_t size; // multiple of HUGEPAGE_SIZE
+} HugePageMapping;
+
+// a backing allocator for arenas and slabs that span gigabytes, allocations
+// are HUGEPAGE_SIZE aligned mmaps advised to use transparent huge pages, which
+// cuts page faults and TLB misses. sizes are rounded up to HUGEPAGE_SIZE, an
+// arena should ask for blocks of that size with arena_set_block_size, or its
+// MIN_ALLOC_BLOCK blocks and their header leave half of each mapping unused.
+// it is not thread safe
+typedef struct HugePageAllocator {
+	Allocator *backing;
+	HugePageMapping *mappings;
+	size_t page;
+	int flags;
+} HugePageAllocator;
+
+static HugePageMapping *hugepage_mapping_of(void *p) {
+	return (HugePageMapping *)p - 1;
+}
+
+// faults the pages in after the huge page advice, MAP_POPULATE would fault
+// them before it, as small pages
+static void hugepage_populate(
+	HugePageAllocator *h, unsigned char *p, size_t sz
+) {
+#ifdef MADV_POPULATE_WRITE
+	if (!madvise(p, sz, MADV_POPULATE_WRITE)) return;
+#endif
+	for (size_t off = 0; off < sz; off += h->page) {
+		((volatile unsigned char *)p)[off] = 0;
+	}
+}
+
+static void *hugepage_map(HugePageAllocator *h, size_t sz) {
+	size_t size = alloc_align_up(sz, HUGEPAGE_SIZE);
+	size_t len = size + HUGEPAGE_SIZE;
+	unsigned char *raw = 0, *p = 0;
+	if (size < sz || len < size) return 0;
+	raw = mmap(
+		0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+	);
+	if (raw == MAP_FAILED) return 0;
+	// one page before the aligned range keeps the mapping header
+	p = (unsigned char *)alloc_align_up((size_t)raw + h->page, HUGEPAGE_SIZE);
+	if (p - h->page > raw) munmap(raw, p - h->page - raw);
+	if (p + size < raw + len) munmap(p + size, raw + len - (p + size));
+	madvise(p, size, MADV_HUGEPAGE);
+	if (h->flags & HUGEPAGE_POPULATE) hugepage_populate(h, p, size);
+	HugePageMapping *m = hugepage_mapping_of(p);
+	*m = (HugePageMapping){ .next = h->mappings, .size = size };
+	if (h->mappings) h->mappings->prev = m;
+	h->mappings = m;
+	return p;
+}
+
+static void hugepage_unmap(HugePageAllocator *h, HugePageMapping *m) {
+	if (m->prev) m->prev->next = m->next;
+	else h->mappings = m->next;
+	if (m->next) m->next->prev = m->prev;
+	unsigned char *p = (unsigned char *)(m + 1);
+	munmap(p - h->page, m->size + h->page);
+}
+
+// only HUGEPAGE_SIZE aligned pointers can be mappings, the list is walked for
+// those alone
+static HugePageMapping *hugepage_find(HugePageAllocator *h, void *p) {
+	if (!p || (size_t)p % HUGEPAGE_SIZE) return 0;
+	for (HugePageMapping *m = h->mappings; m; m = m->next) {
+		if (m + 1 == p) return m;
+	}
+	return 0;
+}
+
+static void *hugepage_realloc(
+	HugePageAllocator *h, void *old, size_t oldsz, size_t newsz
+) {
+	HugePageMapping *m = hugepage_find(h, old);
+	void *p = 0;
+	if (!m && newsz < HUGEPAGE_MIN_ALLOC)
+		return alloc_realloc(h->backing, old, oldsz, newsz);
+	if (m && newsz >= HUGEPAGE_MIN_ALLOC && newsz <= m->size) return old;
+	if (newsz >= HUGEPAGE_MIN_ALLOC) p = hugepage_map(h, newsz);
+	else p = alloc_new(h->backing, newsz);
+	if (!p) return 0;
+	if (old) memcpy(p, old, MIN(oldsz, newsz));
+	if (m) hugepage_unmap(h, m);
+	else if (old) alloc_free(h->backing, old);
+	return p;
+}
+
+static void hugepage_release(HugePageAllocator *h) {
+	while (h->mappings) hugepage_unmap(h, h->mappings);
+}
+
+static void *hugepage_alloc_fn(Allocator *a, AllocatorOP op) {
+	HugePageAllocator *h = a->state;
+	HugePageMapping *m = 0;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		if (
+			op.data.alloc.size < HUGEPAGE_MIN_ALLOC &&
+			op.data.alloc.align <= HUGEPAGE_SIZE
+		) return alloc_new_aligned(
+			h->backing, op.data.alloc.size, op.data.alloc.align
+		);
+		if (op.data.alloc.align > HUGEPAGE_SIZE) return 0;
+		return hugepage_map(h, op.data.alloc.size);
+	case ALLOC_FREE:
+		if ((m = hugepage_find(h, op.data.free.ptr))) hugepage_unmap(h, m);
+		else alloc_free(h->backing, op.data.free.ptr);
+		return 0;
+	case ALLOC_FREE_ALL:
+		// unmaps every mapping. the smaller allocations live in the backing
+		// allocator, which holds the state too, so it is left alone
+		hugepage_release(h);
+		return 0;
+	case ALLOC_REALLOC:
+		return hugepage_realloc(
+			h, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		if (hugepage_find(h, op.data.owns.ptr)) return a;
+		return alloc_owns(h->backing, op.data.owns.ptr) ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+// 'flags' is a set of HugePageFlags, the state and the requests smaller than
+// HUGEPAGE_MIN_ALLOC go to 'backing'
+static int hugepage_allocator_init(
+	Allocator *a, Allocator *backing, int flags
+) {
+	*a = (Allocator){0};
+	HugePageAllocator *h = 0;
+	if (!(h = alloc_new(backing, sizeof(HugePageAllocator)))) return -1;
+	*h = (HugePageAllocator){
+		.backing = backing,
+		.page = (size_t)sysconf(_SC_PAGESIZE),
+		.flags = flags,
+	};
+	*a = (Allocator){.alloc_fn = &hugepage_alloc_fn, .state = h};
+	return 0;
+}
+
+static void hugepage_allocator_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &hugepage_alloc_fn) return;
+	HugePageAllocator *h = a->state;
+	hugepage_release(h);
+	alloc_free(h->backing, h);
+	*a = (Allocator){0};
+}
+
+#endif // HUGEPAGE_ALLOCATOR_H
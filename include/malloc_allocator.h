@@ -4,9 +4,13 @@
 #include "allocator.h"
 
 static void *malloc_alloc_func(Allocator *_, AllocatorOP op) {
+	void *p = 0;
 	switch (op.opcode) {
 	case ALLOC_ALLOC:
-		return malloc(op.data.alloc.size);
+		if (op.data.alloc.align <= ALLOC_DEFAULT_ALIGN)
+			return malloc(op.data.alloc.size);
+		if (posix_memalign(&p, op.data.alloc.align, op.data.alloc.size)) return 0;
+		return p;
 	case ALLOC_FREE:
 		free(op.data.free.ptr);
 		return (void *)0;
@@ -14,6 +18,8 @@ static void *malloc_alloc_func(Allocator *_, AllocatorOP op) {
 		return (void *)0;
 	case ALLOC_REALLOC:
 		return realloc(op.data.realloc.old, op.data.realloc.newsz);
+	default:
+		return 0;
 	}
 }
 
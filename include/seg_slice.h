@@ -0,0 +1,157 @@
+#ifndef SEG_SLICE_H
+#define SEG_SLICE_H
+
+#include "allocator.h"
+
+// items of the first segment when none is given
+#ifndef SEG_SLICE_FIRST
+#define SEG_SLICE_FIRST 64
+#endif
+
+// segment k holds first << k items, 48 of them hold at least 2^48 items
+#define SEG_SLICE_SEGMENTS 48
+
+// a sequence of geometrically growing segments. growing allocates the next
+// segment and never moves the items, so their addresses stay valid until
+// the slice is destroyed or they are popped, and an arena backed slice never
+// pays for the copies of a realloc. indexing is O(1), the segment is found
+// from the highest bit of the index
+typedef struct SegSlice {
+	char *segs[SEG_SLICE_SEGMENTS];
+	size_t nsegs;
+	size_t isz;
+	size_t len;
+	size_t cap;
+	size_t shift; // log2 of the items in the first segment
+	Allocator *a;
+} SegSlice;
+
+// 'first' is rounded up to a power of two, 0 takes SEG_SLICE_FIRST
+static void seg_slice_init(
+	SegSlice *s, Allocator *a, size_t item_size, size_t first
+) {
+	*s = (SegSlice){0};
+	s->isz = item_size;
+	s->a = a;
+	if (!first) first = SEG_SLICE_FIRST;
+	while (((size_t)1 << s->shift) < first) s->shift++;
+}
+
+static void seg_slice_destroy(SegSlice *s) {
+	for (size_t k = 0; k < s->nsegs; k++) alloc_free(s->a, s->segs[k]);
+	*s = (SegSlice){0};
+}
+
+// segment of 'index' and its offset in it
+static size_t seg_slice_locate(SegSlice *s, size_t index, size_t *offset) {
+	size_t j = (index >> s->shift) + 1;
+	size_t k = (sizeof(size_t)*8 - 1) - __builtin_clzl(j);
+	*offset = index - ((((size_t)1 << k) - 1) << s->shift);
+	return k;
+}
+
+// address of 'index', not checked, as in an array
+static inline void *seg_slice_at(SegSlice *s, size_t index) {
+	size_t offset = 0, k = seg_slice_locate(s, index, &offset);
+	return s->segs[k] + offset*s->isz;
+}
+
+// adds segments until 'count' more items fit
+static int seg_slice_reserve(SegSlice *s, size_t count) {
+	if (!s->a || !s->isz) return -1;
+	while (s->cap - s->len < count) {
+		size_t n = 0;
+		char *p = 0;
+		if (
+			s->nsegs == SEG_SLICE_SEGMENTS ||
+			s->shift + s->nsegs >= sizeof(size_t)*8 - 1
+		) return -1;
+		n = (size_t)1 << (s->shift + s->nsegs);
+		if (n > ((size_t)-1)/s->isz) return -1;
+		if (!(p = alloc_new(s->a, n*s->isz))) return 1;
+		s->segs[s->nsegs++] = p;
+		s->cap += n;
+	}
+	return 0;
+}
+
+// the items are copied a segment at a time, a run may span several of them
+static int seg_slice_append_multi(SegSlice *s, void *value, size_t count) {
+	int err = 0;
+	char *src = value;
+	if ((err = seg_slice_reserve(s, count))) return err;
+	while (count) {
+		size_t offset = 0, k = seg_slice_locate(s, s->len, &offset);
+		size_t n = MIN(count, ((size_t)1 << (s->shift + k)) - offset);
+		memcpy(s->segs[k] + offset*s->isz, src, n*s->isz);
+		src += n*s->isz;
+		s->len += n;
+		count -= n;
+	}
+	return 0;
+}
+
+static int seg_slice_append(SegSlice *s, void *value) {
+	int err = 0;
+	if (s->len == s->cap && (err = seg_slice_reserve(s, 1))) return err;
+	memcpy(seg_slice_at(s, s->len), value, s->isz);
+	s->len++;
+	return 0;
+}
+
+static int seg_slice_get(SegSlice *s, size_t index, void *dest) {
+	if (index >= s->len) return 1;
+	memcpy(dest, seg_slice_at(s, index), s->isz);
+	return 0;
+}
+
+// the address stays valid while the slice grows
+static int seg_slice_get_ptr(SegSlice *s, size_t index, size_t *dest) {
+	if (index >= s->len) return 1;
+	*dest = (size_t)seg_slice_at(s, index);
+	return 0;
+}
+
+static int seg_slice_set(SegSlice *s, size_t index, void *value) {
+	if (index >= s->len) return 1;
+	memcpy(seg_slice_at(s, index), value, s->isz);
+	return 0;
+}
+
+static int seg_slice_pop(SegSlice *s, void *dest) {
+	if (!s->len) {
+		memset(dest, 0, s->isz);
+		return -1;
+	}
+	memcpy(dest, seg_slice_at(s, s->len-1), s->isz);
+	s->len--;
+	return 0;
+}
+
+// segment 'k' and the items used in it, for scans that walk the items in
+// runs instead of one index at a time. null past the last used segment
+static void *seg_slice_segment(SegSlice *s, size_t k, size_t *count) {
+	size_t start = 0, n = 0;
+	*count = 0;
+	if (k >= s->nsegs) return 0;
+	start = (((size_t)1 << k) - 1) << s->shift;
+	n = (size_t)1 << (s->shift + k);
+	if (start >= s->len) return 0;
+	*count = MIN(n, s->len - start);
+	return s->segs[k];
+}
+
+static size_t seg_slice_len(SegSlice *s) {
+	return s->len;
+}
+
+static size_t seg_slice_cap(SegSlice *s) {
+	return s->cap;
+}
+
+// keeps the segments for reuse
+static void seg_slice_reset(SegSlice *s) {
+	s->len = 0;
+}
+
+#endif // SEG_SLICE_H
@@ -0,0 +1,411 @@
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include "allocator.h"
+#include <stdatomic.h>
+
+// size classes go from 16 bytes (1 << SLAB_MIN_SHIFT) up to
+// 16 << (SLAB_N_CLASSES-1) bytes, bigger allocations go to the backing
+// allocator
+#ifndef SLAB_MIN_SHIFT
+#define SLAB_MIN_SHIFT 4
+#endif
+
+#ifndef SLAB_N_CLASSES
+#define SLAB_N_CLASSES 8
+#endif
+
+// a power of two up to 16 MiB, blocks are aligned to it
+#ifndef SLAB_BLOCK_SIZE
+#define SLAB_BLOCK_SIZE (((size_t)1) << 16)
+#endif
+
+#define SLAB_LARGE ((size_t)SLAB_N_CLASSES)
+
+// the block number of a 48 bit address is split in a root index and two
+// levels of SLAB_MAP_BITS, the page map has a node and a leaf per level
+#ifndef SLAB_MAP_BITS
+#define SLAB_MAP_BITS 12
+#endif
+
+#define SLAB_MAP_LEN (((size_t)1) << SLAB_MAP_BITS)
+#define SLAB_MAP_ROOT \
+	(((((size_t)1) << 48)/SLAB_BLOCK_SIZE) >> 2*SLAB_MAP_BITS)
+
+// chunks carry no header, while a chunk sits in a free list its first word
+// links it to the following free chunk
+typedef struct SlabChunk {
+	struct SlabChunk *next;
+} SlabChunk;
+
+// blocks are SLAB_BLOCK_SIZE aligned and hold chunks of a single class, the
+// page map gives the class of a chunk from its block number
+typedef struct SlabBlock {
+	struct SlabBlock *prev;
+} SlabBlock;
+
+// allocations bigger than the biggest class or with a bigger alignment than
+// ALLOC_DEFAULT_ALIGN are plain backing allocations, this header right before
+// the pointer links them so they can be released. 'raw' is what the backing
+// allocator returned
+typedef struct SlabLarge {
+	struct SlabLarge *prev;
+	struct SlabLarge *next;
+	void *raw;
+} SlabLarge;
+
+// the leaves have a byte per block, its class plus one or 0 when the block is
+// not one of ours
+typedef struct SlabMapNode {
+	_Atomic(unsigned char *) leaves[SLAB_MAP_LEN];
+} SlabMapNode;
+
+typedef struct SlabAllocator {
+	Allocator *backing;
+	SlabBlock *last_block;
+	SlabLarge *large;
+	SlabChunk *free[SLAB_N_CLASSES];
+	unsigned char *cur[SLAB_N_CLASSES];
+	unsigned char *end[SLAB_N_CLASSES];
+	// nodes are published with release stores and never move, so the thread
+	// cache finds the class of a chunk without the lock
+	_Atomic(SlabMapNode *) map[SLAB_MAP_ROOT];
+} SlabAllocator;
+
+static size_t slab_class(size_t sz) {
+	size_t cls = 0;
+	for (size_t csz = ((size_t)1) << SLAB_MIN_SHIFT; csz < sz; csz <<= 1) {
+		if (++cls == SLAB_LARGE) break;
+	}
+	return cls;
+}
+
+static size_t slab_class_size(size_t cls) {
+	return ((size_t)1) << (cls + SLAB_MIN_SHIFT);
+}
+
+static size_t slab_header_size(void) {
+	return alloc_align_up(sizeof(SlabBlock), ALLOC_DEFAULT_ALIGN);
+}
+
+static size_t slab_large_header_size(size_t align) {
+	return alloc_align_up(sizeof(SlabLarge), MAX(align, ALLOC_DEFAULT_ALIGN));
+}
+
+static SlabLarge *slab_large_of(void *p) {
+	return (SlabLarge *)p - 1;
+}
+
+// class of the block holding 'p' plus one, 0 when it is not in one of ours
+static size_t slab_map_get(SlabAllocator *s, void *p) {
+	size_t key = (size_t)p / SLAB_BLOCK_SIZE;
+	SlabMapNode *node = 0;
+	unsigned char *leaf = 0;
+	if ((key >> 2*SLAB_MAP_BITS) >= SLAB_MAP_ROOT) return 0;
+	node = atomic_load_explicit(
+		&s->map[key >> 2*SLAB_MAP_BITS], memory_order_acquire
+	);
+	if (!node) return 0;
+	leaf = atomic_load_explicit(
+		&node->leaves[(key >> SLAB_MAP_BITS) & (SLAB_MAP_LEN-1)],
+		memory_order_acquire
+	);
+	if (!leaf) return 0;
+	return leaf[key & (SLAB_MAP_LEN-1)];
+}
+
+// the missing node and leaf on the path of the block are made first
+static int slab_map_set(SlabAllocator *s, void *block, size_t cls) {
+	size_t key = (size_t)block / SLAB_BLOCK_SIZE;
+	SlabMapNode *node = 0;
+	unsigned char *leaf = 0;
+	if ((key >> 2*SLAB_MAP_BITS) >= SLAB_MAP_ROOT) return -1;
+	_Atomic(SlabMapNode *) *root = &s->map[key >> 2*SLAB_MAP_BITS];
+	if (!(node = atomic_load_explicit(root, memory_order_relaxed))) {
+		if (!(node = alloc_new(s->backing, sizeof(SlabMapNode)))) return -1;
+		memset(node, 0, sizeof(SlabMapNode));
+		atomic_store_explicit(root, node, memory_order_release);
+	}
+	_Atomic(unsigned char *) *slot =
+		&node->leaves[(key >> SLAB_MAP_BITS) & (SLAB_MAP_LEN-1)];
+	if (!(leaf = atomic_load_explicit(slot, memory_order_relaxed))) {
+		if (!(leaf = alloc_new(s->backing, SLAB_MAP_LEN))) return -1;
+		memset(leaf, 0, SLAB_MAP_LEN);
+		atomic_store_explicit(slot, leaf, memory_order_release);
+	}
+	leaf[key & (SLAB_MAP_LEN-1)] = (unsigned char)(cls + 1);
+	return 0;
+}
+
+static void slab_map_release(SlabAllocator *s) {
+	for (size_t i = 0; i < SLAB_MAP_ROOT; i++) {
+		SlabMapNode *node = 0;
+		node = atomic_load_explicit(&s->map[i], memory_order_relaxed);
+		if (!node) continue;
+		for (size_t j = 0; j < SLAB_MAP_LEN; j++) {
+			unsigned char *leaf =
+				atomic_load_explicit(&node->leaves[j], memory_order_relaxed);
+			if (leaf) alloc_free(s->backing, leaf);
+		}
+		alloc_free(s->backing, node);
+		atomic_store_explicit(&s->map[i], 0, memory_order_relaxed);
+	}
+}
+
+// SLAB_LARGE for the pointers that are not in a block
+static size_t slab_class_of(SlabAllocator *s, void *p) {
+	size_t cls = slab_map_get(s, p);
+	return cls ? cls - 1 : SLAB_LARGE;
+}
+
+static int slab_grow(SlabAllocator *s, size_t cls) {
+	unsigned char *p = 0;
+	if (!(p = alloc_new_aligned(s->backing, SLAB_BLOCK_SIZE, SLAB_BLOCK_SIZE)))
+		return -1;
+	if (slab_map_set(s, p, cls)) {
+		alloc_free(s->backing, p);
+		return -1;
+	}
+	*((SlabBlock *)p) = (SlabBlock){ .prev = s->last_block };
+	s->last_block = (SlabBlock *)p;
+	s->cur[cls] = p + slab_header_size();
+	s->end[cls] = p + SLAB_BLOCK_SIZE;
+	return 0;
+}
+
+static void *slab_large_link(SlabAllocator *s, void *raw, void *p) {
+	SlabLarge *l = slab_large_of(p);
+	*l = (SlabLarge){ .next = s->large, .raw = raw };
+	if (s->large) s->large->prev = l;
+	s->large = l;
+	return p;
+}
+
+static void slab_large_unlink(SlabAllocator *s, SlabLarge *l) {
+	if (l->prev) l->prev->next = l->next;
+	else s->large = l->next;
+	if (l->next) l->next->prev = l->prev;
+}
+
+static void *slab_alloc_large(SlabAllocator *s, size_t sz, size_t align) {
+	size_t hdrsz = slab_large_header_size(align);
+	unsigned char *raw = 0;
+	if (hdrsz + sz < sz) return 0;
+	if (!(raw = alloc_new_aligned(
+		s->backing, hdrsz + sz, MAX(align, ALLOC_DEFAULT_ALIGN)
+	))) return 0;
+	return slab_large_link(s, raw, raw + hdrsz);
+}
+
+static void *slab_alloc_aligned(SlabAllocator *s, size_t sz, size_t align) {
+	size_t cls = slab_class(sz);
+	SlabChunk *c = 0;
+	if (cls == SLAB_LARGE || align > ALLOC_DEFAULT_ALIGN)
+		return slab_alloc_large(s, sz, align);
+	if ((c = s->free[cls])) {
+		s->free[cls] = c->next;
+		return c;
+	}
+	size_t chunksz = slab_class_size(cls);
+	if ((size_t)(s->end[cls] - s->cur[cls]) < chunksz && slab_grow(s, cls))
+		return 0;
+	c = (SlabChunk *)s->cur[cls];
+	s->cur[cls] += chunksz;
+	return c;
+}
+
+static void *slab_alloc(SlabAllocator *s, size_t sz) {
+	return slab_alloc_aligned(s, sz, ALLOC_DEFAULT_ALIGN);
+}
+
+static void slab_free(SlabAllocator *s, void *p) {
+	if (!p) return;
+	size_t cls = slab_class_of(s, p);
+	if (cls == SLAB_LARGE) {
+		SlabLarge *l = slab_large_of(p);
+		slab_large_unlink(s, l);
+		alloc_free(s->backing, l->raw);
+		return;
+	}
+	SlabChunk *c = p;
+	c->next = s->free[cls];
+	s->free[cls] = c;
+}
+
+// a backing realloc, which may grow in place. the backing allocator would not
+// keep a bigger alignment, those allocations move
+static void *slab_realloc_large(
+	SlabAllocator *s, void *old, size_t oldsz, size_t newsz
+) {
+	SlabLarge *l = slab_large_of(old);
+	size_t hdrsz = slab_large_header_size(ALLOC_DEFAULT_ALIGN);
+	unsigned char *raw = l->raw;
+	void *p = 0;
+	if ((unsigned char *)old - raw == (ptrdiff_t)hdrsz && hdrsz + newsz > newsz) {
+		// the neighbours point to the header, it is linked again after the move
+		slab_large_unlink(s, l);
+		p = alloc_realloc(s->backing, raw, hdrsz + oldsz, hdrsz + newsz);
+		if (!p) {
+			slab_large_link(s, raw, old);
+			return 0;
+		}
+		return slab_large_link(s, p, (unsigned char *)p + hdrsz);
+	}
+	if (!(p = slab_alloc(s, newsz))) return 0;
+	memcpy(p, old, MIN(oldsz, newsz));
+	slab_free(s, old);
+	return p;
+}
+
+static void *slab_realloc(
+	SlabAllocator *s, void *old, size_t oldsz, size_t newsz
+) {
+	if (!old) return slab_alloc(s, newsz);
+	size_t cls = slab_class_of(s, old), newcls = slab_class(newsz);
+	if (cls != SLAB_LARGE && newcls == cls) return old;
+	if (cls == SLAB_LARGE && newcls == SLAB_LARGE)
+		return slab_realloc_large(s, old, oldsz, newsz);
+	void *p = 0;
+	if (!(p = slab_alloc(s, newsz))) return 0;
+	memcpy(p, old, MIN(oldsz, newsz));
+	slab_free(s, old);
+	return p;
+}
+
+// pops the class free list, then carves the rest from the current block, a
+// block at a time. allocations that do not fit a class are left to the
+// generic fallback
+static void *slab_alloc_batch(
+	SlabAllocator *s, size_t sz, size_t count, void **out
+) {
+	size_t cls = slab_class(sz), i = 0;
+	if (cls == SLAB_LARGE) return 0;
+	size_t chunksz = slab_class_size(cls);
+	SlabChunk *c = s->free[cls];
+	for (; i < count && c; i++, c = c->next) out[i] = c;
+	s->free[cls] = c;
+	while (i < count) {
+		size_t n = (size_t)(s->end[cls] - s->cur[cls]) / chunksz;
+		if (!n) {
+			if (!slab_grow(s, cls)) continue;
+			for (; i > 0; i--) slab_free(s, out[i-1]);
+			return ALLOC_BATCH_FAILED;
+		}
+		for (n = MIN(n, count - i); n; n--, i++) {
+			out[i] = s->cur[cls];
+			s->cur[cls] += chunksz;
+		}
+	}
+	return out;
+}
+
+// chains the chunks of each class and splices every chain into its free list
+// once
+static void *slab_free_batch(SlabAllocator *s, void **ptrs, size_t count) {
+	SlabChunk *head[SLAB_N_CLASSES] = {0}, *tail[SLAB_N_CLASSES] = {0};
+	for (size_t i = 0; i < count; i++) {
+		if (!ptrs[i]) continue;
+		size_t cls = slab_class_of(s, ptrs[i]);
+		if (cls == SLAB_LARGE) {
+			slab_free(s, ptrs[i]);
+			continue;
+		}
+		SlabChunk *c = ptrs[i];
+		c->next = head[cls];
+		if (!head[cls]) tail[cls] = c;
+		head[cls] = c;
+	}
+	for (size_t cls = 0; cls < SLAB_N_CLASSES; cls++) {
+		if (!head[cls]) continue;
+		tail[cls]->next = s->free[cls];
+		s->free[cls] = head[cls];
+	}
+	return ptrs;
+}
+
+// chunks are found in the page map, large allocations walk their list
+static int slab_owns(SlabAllocator *s, void *p) {
+	if (slab_map_get(s, p))
+		return (size_t)p % SLAB_BLOCK_SIZE >= slab_header_size();
+	for (SlabLarge *l = s->large; l; l = l->next) {
+		if (l + 1 == p) return 1;
+	}
+	return 0;
+}
+
+static void slab_release(SlabAllocator *s) {
+	for (SlabBlock *b = 0; s->last_block; s->last_block = b) {
+		b = s->last_block->prev;
+		alloc_free(s->backing, s->last_block);
+	}
+	for (SlabLarge *l = 0; s->large; s->large = l) {
+		l = s->large->next;
+		alloc_free(s->backing, s->large->raw);
+	}
+	slab_map_release(s);
+	Allocator *backing = s->backing;
+	*s = (SlabAllocator){0};
+	s->backing = backing;
+}
+
+// typed entry points that skip the alloc_fn dispatch, 'a' must be a slab
+static inline void *slab_alloc_fast(Allocator *a, size_t sz) {
+	return slab_alloc((SlabAllocator *)a->state, sz);
+}
+
+static inline void slab_free_fast(Allocator *a, void *p) {
+	slab_free((SlabAllocator *)a->state, p);
+}
+
+static void *slab_alloc_fn(Allocator *a, AllocatorOP op) {
+	SlabAllocator *s = a->state;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		return slab_alloc_aligned(s, op.data.alloc.size, op.data.alloc.align);
+	case ALLOC_FREE:
+		slab_free(s, op.data.free.ptr);
+		return 0;
+	case ALLOC_FREE_ALL:
+		slab_release(s);
+		return 0;
+	case ALLOC_REALLOC:
+		return slab_realloc(
+			s, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_ALLOC_BATCH:
+		return slab_alloc_batch(
+			s,
+			op.data.alloc_batch.size,
+			op.data.alloc_batch.count,
+			op.data.alloc_batch.out
+		);
+	case ALLOC_FREE_BATCH:
+		return slab_free_batch(
+			s, op.data.free_batch.ptrs, op.data.free_batch.count
+		);
+	case ALLOC_OWNS:
+		return slab_owns(s, op.data.owns.ptr) ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+static int slab_allocator_init(Allocator *a, Allocator *backing) {
+	*a = (Allocator){0};
+	SlabAllocator *s = 0;
+	if (!(s = alloc_new(backing, sizeof(SlabAllocator)))) return -1;
+	*s = (SlabAllocator){0};
+	s->backing = backing;
+	*a = (Allocator){.alloc_fn = &slab_alloc_fn, .state = s};
+	return 0;
+}
+
+static void slab_allocator_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &slab_alloc_fn) return;
+	SlabAllocator *s = a->state;
+	slab_release(s);
+	alloc_free(s->backing, s);
+	*a = (Allocator){0};
+}
+
+#endif // SLAB_ALLOCATOR_H
@@ -2,6 +2,7 @@
 #define SLICE_H
 
 #include "allocator.h"
+#include <string.h> // memcpy / memmove / memset
 
 typedef struct { 
 	char *base; 
@@ -18,6 +19,18 @@ static void slice_init(Slice *s, Allocator *a, size_t item_size) {
 	s->a = a;
 }
 
+// starts the slice over 'buf', which holds 'cap' items and is not owned. the
+// slice behaves as a reslice of it: nothing is allocated until it outgrows
+// 'buf', the first growth copies the items to the allocator
+static void slice_init_inline(
+	Slice *s, Allocator *a, size_t item_size, void *buf, size_t cap
+) {
+	slice_init(s, a, item_size);
+	s->base = buf;
+	s->cap = cap;
+	s->is_reslice = 1;
+}
+
 static void slice_destroy(Slice *s) { 
 	if (s->is_reslice) return; // reslices do not own memory
 	if (s->base) alloc_free(s->a, s->base); 
@@ -35,37 +48,41 @@ static int slice_reslice(
 	Slice *s, Slice *reslice, size_t startlen, size_t endlen
 ) {
 	if (startlen > s->len) return -1;
-	if (endlen > s->len) return -2;
+	if (endlen > s->len || endlen < startlen) return -2;
 	*reslice = *s;
 	reslice->is_reslice = 1;
-	reslice->base += startlen;
+	reslice->base += startlen*s->isz;
 	reslice->cap -= startlen;
-	reslice->len -= startlen;
+	reslice->len = endlen - startlen;
 	return 0;
 }
 
-static int slice_append_multi(Slice *s, void *value, size_t count) {
-	if (!s->a || !s->isz) return -1; 
-	if (s->cap - s->len >= count) {
-		memcpy(s->base+(s->len*s->isz), value, count*s->isz);
-		s->len += count;
-		return 0;
-	} 
-	size_t new_cap = MAX(s->cap*2, count); 
+// makes room for 'count' more items, the growth shared by every append.
+// reslices do not own their memory, they get a copy of their items
+static int slice_reserve(Slice *s, size_t count) {
+	if (!s->a || !s->isz) return -1;
+	if (s->cap - s->len >= count) return 0;
+	size_t new_cap = MAX(s->cap*2, s->len + count);
 	char *p = 0;
-	if (!s->base) p = alloc_new(s->a, s->isz*new_cap); 
-	else if (!s->is_reslice) p = alloc_realloc( 
-		s->a, (void *)s->base, s->isz*s->cap, s->isz*new_cap 
-	); else {
-		p = alloc_new(s->a, s->isz*new_cap);
+	if (!s->base) p = alloc_new(s->a, s->isz*new_cap);
+	else if (!s->is_reslice) p = alloc_realloc(
+		s->a, (void *)s->base, s->isz*s->cap, s->isz*new_cap
+	); else if ((p = alloc_new(s->a, s->isz*new_cap))) {
+		memcpy(p, s->base, s->len*s->isz);
 	}
-	if (!p) return 1; 
+	if (!p) return 1;
 	s->is_reslice = 0;
-	s->base = p; 
-	s->cap = new_cap; 
+	s->base = p;
+	s->cap = new_cap;
+	return 0;
+}
+
+static int slice_append_multi(Slice *s, void *value, size_t count) {
+	int err = 0;
+	if ((err = slice_reserve(s, count))) return err;
 	memcpy(s->base+(s->len*s->isz), value, count*s->isz);
 	s->len += count;
-	return 0; 
+	return 0;
 }
  
 static int slice_append(Slice *s, void *value) { 
@@ -111,8 +128,11 @@ static int slice_grow_cap_at(Slice *s, size_t cap) {
 	if (s->cap >= cap) return 0;
 	size_t new_cap = MAX(cap, s->cap*2);
 	void *p = 0;
-	if (s->is_reslice || !s->base) p = alloc_new(s->a, new_cap); 
-	else p = alloc_realloc(s->a, s->base, s->cap, new_cap);
+	if (!s->base) p = alloc_new(s->a, new_cap*s->isz);
+	else if (!s->is_reslice)
+		p = alloc_realloc(s->a, s->base, s->cap*s->isz, new_cap*s->isz);
+	else if ((p = alloc_new(s->a, new_cap*s->isz)))
+		memcpy(p, s->base, s->len*s->isz);
 	if (!p) return -1;
 	s->is_reslice = 0;
 	s->base = p;
@@ -135,13 +155,39 @@ static int slice_uremove(Slice *s, size_t index) {
 	return 0; 
 } 
 
+// replaces the 'remove' items at 'index' with 'count' items from 'value',
+// shifting the tail once. 'value' must not point inside the slice, growing
+// may move it
+static int slice_splice(
+	Slice *s, size_t index, size_t remove, void *value, size_t count
+) {
+	int err = 0;
+	if (index > s->len || remove > s->len - index) return 1;
+	if (count > remove && (err = slice_reserve(s, count - remove))) return err;
+	size_t tail = s->len - index - remove;
+	if (tail) memmove(
+		s->base+((index+count)*s->isz),
+		s->base+((index+remove)*s->isz),
+		tail*s->isz
+	);
+	if (count) memcpy(s->base+(index*s->isz), value, count*s->isz);
+	s->len = s->len - remove + count;
+	return 0;
+}
+
+static int slice_insert_multi(
+	Slice *s, size_t index, void *value, size_t count
+) {
+	return slice_splice(s, index, 0, value, count);
+}
+
+static int slice_remove_range(Slice *s, size_t index, size_t count) {
+	return slice_splice(s, index, count, 0, 0);
+}
+
 static int slice_oremove(Slice *s, size_t index) { 
 	if (s->len-1 < index) return 1;  
-	for (size_t i = index; i < s->len-1; i++) { 
-		memcpy(s->base+(i*s->isz), s->base+((i+1)*s->isz), s->isz);
-	} 
-	s->len--; 
-	return 0; 
+	return slice_remove_range(s, index, 1);
 } 
 
 static int slice_peek(Slice *s, void *dest) {
@@ -175,5 +221,70 @@ static void slice_reset(Slice *s) {
 	if (s->base) s->len = 0; 
 } 
 
+// SLICE_DEFINE(name, T) generates Slice_name, a Slice of T with inlined by
+// value accessors that skip the memcpy of the type erased ones. 's' is a plain
+// Slice, growth goes through slice_reserve and every slice_ function still
+// works on it. indexes are not checked, as in an array
+#define SLICE_DEFINE(name, T)\
+typedef struct Slice_##name { Slice s; } Slice_##name;\
+\
+static inline void slice_##name##_init(Slice_##name *s, Allocator *a) {\
+	slice_init(&s->s, a, sizeof(T));\
+}\
+\
+static inline size_t slice_##name##_len(Slice_##name *s) {\
+	return s->s.len;\
+}\
+\
+static inline T *slice_##name##_begin(Slice_##name *s) {\
+	return (T *)s->s.base;\
+}\
+\
+static inline T *slice_##name##_end(Slice_##name *s) {\
+	return (T *)s->s.base + s->s.len;\
+}\
+\
+static inline T *slice_##name##_at(Slice_##name *s, size_t index) {\
+	return (T *)s->s.base + index;\
+}\
+\
+static inline T slice_##name##_get(Slice_##name *s, size_t index) {\
+	return ((T *)s->s.base)[index];\
+}\
+\
+static inline void slice_##name##_set(Slice_##name *s, size_t index, T v) {\
+	((T *)s->s.base)[index] = v;\
+}\
+\
+static inline int slice_##name##_append(Slice_##name *s, T v) {\
+	int err = 0;\
+	if (s->s.len == s->s.cap && (err = slice_reserve(&s->s, 1))) return err;\
+	((T *)s->s.base)[s->s.len++] = v;\
+	return 0;\
+}\
+\
+static inline int slice_##name##_pop(Slice_##name *s, T *dest) {\
+	if (!s->s.len) return -1;\
+	*dest = ((T *)s->s.base)[--s->s.len];\
+	return 0;\
+}
+
+// SLICE_SMALL_DEFINE(name, T, N) generates SliceSmall_name, a Slice of T with
+// inline storage for its first N items, so small collections never allocate.
+// 's' is a plain Slice and every slice_ function works on it. while the items
+// are inline 's' points inside the struct, which must not be copied or moved
+#define SLICE_SMALL_DEFINE(name, T, N)\
+typedef struct SliceSmall_##name { Slice s; T items[N]; } SliceSmall_##name;\
+\
+static inline void slice_small_##name##_init(\
+	SliceSmall_##name *s, Allocator *a\
+) {\
+	slice_init_inline(&s->s, a, sizeof(T), s->items, N);\
+}\
+\
+static inline int slice_small_##name##_is_inline(SliceSmall_##name *s) {\
+	return s->s.base == (char *)s->items;\
+}
+
 #endif // SLICE_H
 
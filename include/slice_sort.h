@@ -0,0 +1,254 @@
+#ifndef SLICE_SORT_H
+#define SLICE_SORT_H
+
+#include <stdint.h>
+#include "slice.h"
+
+// comparators get pointers to the items, negative when 'a' goes before 'b',
+// zero when they are equal and positive otherwise
+typedef int (*SliceCmp)(void *ctx, void *a, void *b);
+
+// ranges smaller than this are insertion sorted
+#ifndef SLICE_SORT_SMALL
+#define SLICE_SORT_SMALL 16
+#endif
+
+// the common item sizes swap with fixed size copies, which compile to plain
+// loads and stores, the rest in chunks
+static void slice_sort_swap(char *a, char *b, size_t isz) {
+	if (a == b) return;
+	switch (isz) {
+	case 4: {
+		uint32_t t;
+		memcpy(&t, a, 4);
+		memcpy(a, b, 4);
+		memcpy(b, &t, 4);
+		return;
+	}
+	case 8: {
+		uint64_t t;
+		memcpy(&t, a, 8);
+		memcpy(a, b, 8);
+		memcpy(b, &t, 8);
+		return;
+	}
+	case 16: {
+		uint64_t t[2];
+		memcpy(t, a, 16);
+		memcpy(a, b, 16);
+		memcpy(b, t, 16);
+		return;
+	}
+	default:
+		break;
+	}
+	char t[64];
+	for (size_t n = 0; isz; isz -= n, a += n, b += n) {
+		n = MIN(isz, sizeof(t));
+		memcpy(t, a, n);
+		memcpy(a, b, n);
+		memcpy(b, t, n);
+	}
+}
+
+static void slice_sort_insertion(
+	char *base, size_t n, size_t isz, void *ctx, SliceCmp cmp
+) {
+	for (size_t i = 1; i < n; i++) {
+		for (size_t j = i; j && cmp(ctx, base+(j-1)*isz, base+j*isz) > 0; j--)
+			slice_sort_swap(base+(j-1)*isz, base+j*isz, isz);
+	}
+}
+
+static void slice_sort_sift(
+	char *base, size_t root, size_t n, size_t isz, void *ctx, SliceCmp cmp
+) {
+	for (size_t child = 0; (child = 2*root + 1) < n; root = child) {
+		if (child+1 < n && cmp(ctx, base+child*isz, base+(child+1)*isz) < 0)
+			child++;
+		if (cmp(ctx, base+root*isz, base+child*isz) >= 0) return;
+		slice_sort_swap(base+root*isz, base+child*isz, isz);
+	}
+}
+
+static void slice_sort_heap(
+	char *base, size_t n, size_t isz, void *ctx, SliceCmp cmp
+) {
+	for (size_t i = n/2; i > 0; i--)
+		slice_sort_sift(base, i-1, n, isz, ctx, cmp);
+	for (size_t i = n; i > 1; i--) {
+		slice_sort_swap(base, base+(i-1)*isz, isz);
+		slice_sort_sift(base, 0, i-1, isz, ctx, cmp);
+	}
+}
+
+// quicksort with a median of three pivot, ranges that recurse too deep are
+// heap sorted so the worst case stays O(n log n)
+static void slice_sort_intro(
+	char *base, size_t n, size_t isz, size_t depth, void *ctx, SliceCmp cmp
+) {
+	while (n > SLICE_SORT_SMALL) {
+		if (!depth--) {
+			slice_sort_heap(base, n, isz, ctx, cmp);
+			return;
+		}
+		char *lo = base, *mid = base+(n/2)*isz, *hi = base+(n-1)*isz;
+		if (cmp(ctx, mid, lo) < 0) slice_sort_swap(mid, lo, isz);
+		if (cmp(ctx, hi, mid) < 0) {
+			slice_sort_swap(hi, mid, isz);
+			if (cmp(ctx, mid, lo) < 0) slice_sort_swap(mid, lo, isz);
+		}
+		// the pivot waits at the start while the rest is partitioned
+		slice_sort_swap(lo, mid, isz);
+		size_t i = 0, j = n;
+		for (;;) {
+			while (++i < n && cmp(ctx, base+i*isz, lo) < 0);
+			while (cmp(ctx, base+(--j)*isz, lo) > 0);
+			if (i >= j) break;
+			slice_sort_swap(base+i*isz, base+j*isz, isz);
+		}
+		slice_sort_swap(lo, base+j*isz, isz);
+		// recurses on the smaller side, loops on the bigger one
+		if (j < n-j-1) {
+			slice_sort_intro(base, j, isz, depth, ctx, cmp);
+			base += (j+1)*isz;
+			n -= j+1;
+		} else {
+			slice_sort_intro(base+(j+1)*isz, n-j-1, isz, depth, ctx, cmp);
+			n = j;
+		}
+	}
+	slice_sort_insertion(base, n, isz, ctx, cmp);
+}
+
+// sorts in place without allocating, equal items may change order
+static void slice_sort(Slice *s, void *ctx, SliceCmp cmp) {
+	size_t depth = 0;
+	for (size_t n = s->len; n > 1; n >>= 1) depth += 2;
+	slice_sort_intro(s->base, s->len, s->isz, depth, ctx, cmp);
+}
+
+static void slice_sort_merge(
+	char *base, char *tmp, size_t n, size_t isz, void *ctx, SliceCmp cmp
+) {
+	if (n <= SLICE_SORT_SMALL) {
+		slice_sort_insertion(base, n, isz, ctx, cmp);
+		return;
+	}
+	size_t half = n/2;
+	slice_sort_merge(base, tmp, half, isz, ctx, cmp);
+	slice_sort_merge(base+half*isz, tmp, n-half, isz, ctx, cmp);
+	// already in order
+	if (cmp(ctx, base+(half-1)*isz, base+half*isz) <= 0) return;
+	memcpy(tmp, base, half*isz);
+	char *a = tmp, *aend = tmp+half*isz;
+	char *b = base+half*isz, *bend = base+n*isz;
+	char *out = base;
+	while (a < aend && b < bend) {
+		// ties take the left item, which keeps the sort stable
+		if (cmp(ctx, b, a) < 0) {
+			memcpy(out, b, isz);
+			b += isz;
+		} else {
+			memcpy(out, a, isz);
+			a += isz;
+		}
+		out += isz;
+	}
+	memcpy(out, a, aend-a);
+}
+
+// merge sort, equal items keep their order. it allocates half the slice from
+// the slice allocator
+static int slice_sort_stable(Slice *s, void *ctx, SliceCmp cmp) {
+	char *tmp = 0;
+	if (s->len < 2) return 0;
+	if (!(tmp = alloc_new(s->a, (s->len/2 + 1)*s->isz))) return -1;
+	slice_sort_merge(s->base, tmp, s->len, s->isz, ctx, cmp);
+	alloc_free(s->a, tmp);
+	return 0;
+}
+
+static uint64_t slice_radix_key(char *item, size_t offset, size_t key_size) {
+	uint64_t key = 0;
+	switch (key_size) {
+	case 1: return *(uint8_t *)(item+offset);
+	case 2: { uint16_t k; memcpy(&k, item+offset, 2); return k; }
+	case 4: { uint32_t k; memcpy(&k, item+offset, 4); return k; }
+	default: memcpy(&key, item+offset, 8); return key;
+	}
+}
+
+// stable LSD radix sort on an integer key of 'key_size' bytes (1, 2, 4 or 8)
+// at 'key_offset' in every item, one pass per byte, passes where every key
+// has the same byte are skipped. 'is_signed' orders negative keys first. it
+// allocates a copy of the slice from the slice allocator
+static int slice_radix_sort(
+	Slice *s, size_t key_offset, size_t key_size, int is_signed
+) {
+	size_t n = s->len, isz = s->isz;
+	size_t count[256];
+	char *tmp = 0, *src = s->base, *dst = 0;
+	if (n < 2) return 0;
+	if (
+		(key_size != 1 && key_size != 2 && key_size != 4 && key_size != 8) ||
+		key_offset + key_size > isz
+	) return -2;
+	if (!(tmp = alloc_new(s->a, n*isz))) return -1;
+	dst = tmp;
+	for (size_t pass = 0; pass < key_size; pass++) {
+		size_t shift = pass*8;
+		// the sign bit flips in the most significant byte
+		uint64_t flip = is_signed && pass == key_size-1 ? 0x80 : 0;
+		memset(count, 0, sizeof(count));
+		for (size_t i = 0; i < n; i++) {
+			uint64_t k = slice_radix_key(src+i*isz, key_offset, key_size);
+			count[((k >> shift) & 0xff) ^ flip]++;
+		}
+		uint64_t first = slice_radix_key(src, key_offset, key_size);
+		if (count[((first >> shift) & 0xff) ^ flip] == n) continue;
+		for (size_t d = 0, sum = 0; d < 256; d++) {
+			size_t c = count[d];
+			count[d] = sum;
+			sum += c;
+		}
+		for (size_t i = 0; i < n; i++) {
+			uint64_t k = slice_radix_key(src+i*isz, key_offset, key_size);
+			size_t d = ((k >> shift) & 0xff) ^ flip;
+			memcpy(dst+(count[d]++)*isz, src+i*isz, isz);
+		}
+		char *t = src;
+		src = dst;
+		dst = t;
+	}
+	if (src != s->base) memcpy(s->base, src, n*isz);
+	alloc_free(s->a, tmp);
+	return 0;
+}
+
+// index of the first item that is not less than 'key', len when there is none.
+// the slice must be sorted by 'cmp', which gets the items as 'a' and the key as
+// 'b'
+static size_t slice_lower_bound(
+	Slice *s, void *key, void *ctx, SliceCmp cmp
+) {
+	size_t lo = 0, hi = s->len;
+	while (lo < hi) {
+		size_t mid = lo + (hi-lo)/2;
+		if (cmp(ctx, s->base+mid*s->isz, key) < 0) lo = mid+1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+// as slice_find_ptr, 'dest' gets the address of an item equal to 'key'
+static int slice_bsearch(
+	Slice *s, void *key, void *ctx, SliceCmp cmp, size_t *dest
+) {
+	size_t i = slice_lower_bound(s, key, ctx, cmp);
+	if (i == s->len || cmp(ctx, s->base+i*s->isz, key)) return 0;
+	*dest = (size_t)s->base+(i*s->isz);
+	return 1;
+}
+
+#endif // SLICE_SORT_H
@@ -0,0 +1,165 @@
+#ifndef STATS_ALLOCATOR_H
+#define STATS_ALLOCATOR_H
+
+#include <stdatomic.h>
+#include "allocator.h"
+
+// bucket i counts the allocations with a size in [2^i, 2^(i+1)), sizes of 0
+// go to bucket 0
+#define STATS_HISTOGRAM_BUCKETS (sizeof(size_t)*8)
+
+typedef struct AllocatorStats {
+	size_t allocs;
+	size_t frees;
+	size_t reallocs;
+	size_t live_bytes;
+	size_t peak_bytes;
+	size_t histogram[STATS_HISTOGRAM_BUCKETS];
+} AllocatorStats;
+
+// every allocation is prefixed by its size, 'offset' is the distance to what
+// the backing allocator returned, which grows with the alignment
+typedef struct StatsHeader {
+	size_t size;
+	size_t offset;
+} StatsHeader;
+
+// counts the operations that reach the backing allocator with relaxed
+// atomics, cheap enough to stay on in release builds. it is as thread safe as
+// the backing allocator
+typedef struct StatsAllocator {
+	Allocator *backing;
+	_Atomic size_t allocs;
+	_Atomic size_t frees;
+	_Atomic size_t reallocs;
+	_Atomic size_t live_bytes;
+	_Atomic size_t peak_bytes;
+	_Atomic size_t histogram[STATS_HISTOGRAM_BUCKETS];
+} StatsAllocator;
+
+static size_t stats_bucket(size_t sz) {
+	return sz ? (STATS_HISTOGRAM_BUCKETS-1) - __builtin_clzl(sz) : 0;
+}
+
+static void stats_add_live(StatsAllocator *s, size_t sz) {
+	size_t live = atomic_fetch_add_explicit(
+		&s->live_bytes, sz, memory_order_relaxed
+	) + sz;
+	size_t peak = atomic_load_explicit(&s->peak_bytes, memory_order_relaxed);
+	while (live > peak && !atomic_compare_exchange_weak_explicit(
+		&s->peak_bytes, &peak, live, memory_order_relaxed, memory_order_relaxed
+	));
+}
+
+static void stats_count(StatsAllocator *s, _Atomic size_t *counter, size_t sz) {
+	atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(
+		&s->histogram[stats_bucket(sz)], 1, memory_order_relaxed
+	);
+}
+
+static void *stats_alloc_aligned(StatsAllocator *s, size_t sz, size_t align) {
+	size_t hdrsz = MAX(sizeof(StatsHeader), align);
+	unsigned char *raw = 0;
+	if (!(raw = alloc_new_aligned(s->backing, hdrsz + sz, align))) return 0;
+	StatsHeader *h = (StatsHeader *)(raw + hdrsz) - 1;
+	*h = (StatsHeader){ .size = sz, .offset = hdrsz };
+	stats_count(s, &s->allocs, sz);
+	stats_add_live(s, sz);
+	return h + 1;
+}
+
+static void stats_free(StatsAllocator *s, void *p) {
+	if (!p) return;
+	StatsHeader *h = (StatsHeader *)p - 1;
+	atomic_fetch_add_explicit(&s->frees, 1, memory_order_relaxed);
+	atomic_fetch_sub_explicit(&s->live_bytes, h->size, memory_order_relaxed);
+	alloc_free(s->backing, (unsigned char *)p - h->offset);
+}
+
+static void *stats_realloc(
+	StatsAllocator *s, void *old, size_t oldsz, size_t newsz
+) {
+	if (!old) return stats_alloc_aligned(s, newsz, 0);
+	StatsHeader *h = (StatsHeader *)old - 1;
+	size_t size = h->size;
+	void *p = 0;
+	// over aligned allocations can not keep their padding through a realloc
+	if (h->offset != sizeof(StatsHeader)) {
+		if (!(p = stats_alloc_aligned(s, newsz, 0))) return 0;
+		memcpy(p, old, MIN(size, newsz));
+		stats_free(s, old);
+		return p;
+	}
+	if (!(h = alloc_realloc(
+		s->backing, h, sizeof(StatsHeader) + oldsz, sizeof(StatsHeader) + newsz
+	))) return 0;
+	h->size = newsz;
+	stats_count(s, &s->reallocs, newsz);
+	if (newsz >= size) stats_add_live(s, newsz - size);
+	else atomic_fetch_sub_explicit(
+		&s->live_bytes, size - newsz, memory_order_relaxed
+	);
+	return h + 1;
+}
+
+static void *stats_alloc_fn(Allocator *a, AllocatorOP op) {
+	StatsAllocator *s = a->state;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		return stats_alloc_aligned(s, op.data.alloc.size, op.data.alloc.align);
+	case ALLOC_FREE:
+		stats_free(s, op.data.free.ptr);
+		return 0;
+	case ALLOC_FREE_ALL:
+		// the counters are cumulative, only the live bytes go away
+		alloc_free_all(s->backing);
+		atomic_store_explicit(&s->live_bytes, 0, memory_order_relaxed);
+		return 0;
+	case ALLOC_REALLOC:
+		return stats_realloc(
+			s, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		// the pointer is inside what the backing allocator returned
+		return alloc_owns(s->backing, op.data.owns.ptr) ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+// 's' is the state, owned by the caller and kept out of 'backing' so free all
+// can be forwarded to it
+static int stats_allocator_init(
+	Allocator *a, StatsAllocator *s, Allocator *backing
+) {
+	*s = (StatsAllocator){0};
+	s->backing = backing;
+	*a = (Allocator){.alloc_fn = &stats_alloc_fn, .state = s};
+	return 0;
+}
+
+static void stats_allocator_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &stats_alloc_fn) return;
+	*(StatsAllocator *)a->state = (StatsAllocator){0};
+	*a = (Allocator){0};
+}
+
+// copies the counters, each one is read atomically but they are not read at
+// the same instant
+static void stats_allocator_snapshot(Allocator *a, AllocatorStats *dest) {
+	StatsAllocator *s = a->state;
+	*dest = (AllocatorStats){0};
+	dest->allocs = atomic_load_explicit(&s->allocs, memory_order_relaxed);
+	dest->frees = atomic_load_explicit(&s->frees, memory_order_relaxed);
+	dest->reallocs = atomic_load_explicit(&s->reallocs, memory_order_relaxed);
+	dest->live_bytes = atomic_load_explicit(&s->live_bytes, memory_order_relaxed);
+	dest->peak_bytes = atomic_load_explicit(&s->peak_bytes, memory_order_relaxed);
+	for (size_t i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+		dest->histogram[i] = atomic_load_explicit(
+			&s->histogram[i], memory_order_relaxed
+		);
+	}
+}
+
+#endif // STATS_ALLOCATOR_H
@@ -0,0 +1,215 @@
+#ifndef THREAD_CACHE_ALLOCATOR_H
+#define THREAD_CACHE_ALLOCATOR_H
+
+#include <pthread.h>
+#include "slab_allocator.h"
+
+// max chunks a thread keeps per size class before giving some back
+#ifndef THREAD_CACHE_MAX
+#define THREAD_CACHE_MAX 64
+#endif
+
+// chunks moved between a thread cache and the shared slab under one lock
+#ifndef THREAD_CACHE_BATCH
+#define THREAD_CACHE_BATCH 32
+#endif
+
+struct ThreadCacheAllocator;
+
+typedef struct ThreadCache {
+	struct ThreadCacheAllocator *owner;
+	SlabChunk *free[SLAB_N_CLASSES];
+	size_t count[SLAB_N_CLASSES];
+} ThreadCache;
+
+// a thread safe allocator, each thread pops and pushes chunks from its own
+// cache and only takes the lock to refill or drain it in batches from the
+// shared slab. the backing allocator is only called with the lock held, so
+// it does not need to be thread safe
+typedef struct ThreadCacheAllocator {
+	pthread_mutex_t lock;
+	pthread_key_t key;
+	SlabAllocator slab;
+} ThreadCacheAllocator;
+
+// gives every cached chunk and the cache itself back to the slab, runs when a
+// thread exits
+static void thread_cache_release(void *p) {
+	ThreadCache *c = p;
+	ThreadCacheAllocator *tc = c->owner;
+	pthread_mutex_lock(&tc->lock);
+	for (size_t cls = 0; cls < SLAB_N_CLASSES; cls++) {
+		for (SlabChunk *ch = 0; c->free[cls]; c->free[cls] = ch) {
+			ch = c->free[cls]->next;
+			slab_free(&tc->slab, c->free[cls]);
+		}
+	}
+	slab_free(&tc->slab, c);
+	pthread_mutex_unlock(&tc->lock);
+}
+
+static ThreadCache *thread_cache_get(ThreadCacheAllocator *tc) {
+	ThreadCache *c = pthread_getspecific(tc->key);
+	if (c) return c;
+	pthread_mutex_lock(&tc->lock);
+	c = slab_alloc(&tc->slab, sizeof(ThreadCache));
+	pthread_mutex_unlock(&tc->lock);
+	if (!c) return 0;
+	*c = (ThreadCache){ .owner = tc };
+	if (pthread_setspecific(tc->key, c)) {
+		thread_cache_release(c);
+		return 0;
+	}
+	return c;
+}
+
+static int thread_cache_refill(
+	ThreadCacheAllocator *tc, ThreadCache *c, size_t cls
+) {
+	void *p = 0;
+	pthread_mutex_lock(&tc->lock);
+	for (size_t i = 0; i < THREAD_CACHE_BATCH; i++) {
+		if (!(p = slab_alloc(&tc->slab, slab_class_size(cls)))) break;
+		SlabChunk *ch = p;
+		ch->next = c->free[cls];
+		c->free[cls] = ch;
+		c->count[cls]++;
+	}
+	pthread_mutex_unlock(&tc->lock);
+	return c->free[cls] ? 0 : -1;
+}
+
+static void thread_cache_drain(
+	ThreadCacheAllocator *tc, ThreadCache *c, size_t cls
+) {
+	pthread_mutex_lock(&tc->lock);
+	for (size_t i = 0; i < THREAD_CACHE_BATCH && c->free[cls]; i++) {
+		SlabChunk *ch = c->free[cls];
+		c->free[cls] = ch->next;
+		c->count[cls]--;
+		slab_free(&tc->slab, ch);
+	}
+	pthread_mutex_unlock(&tc->lock);
+}
+
+static void *thread_cache_alloc_aligned(
+	ThreadCacheAllocator *tc, size_t sz, size_t align
+) {
+	size_t cls = slab_class(sz);
+	ThreadCache *c = 0;
+	void *p = 0;
+	if (
+		cls == SLAB_LARGE ||
+		align > ALLOC_DEFAULT_ALIGN ||
+		!(c = thread_cache_get(tc))
+	) {
+		pthread_mutex_lock(&tc->lock);
+		p = slab_alloc_aligned(&tc->slab, sz, align);
+		pthread_mutex_unlock(&tc->lock);
+		return p;
+	}
+	if (!c->free[cls] && thread_cache_refill(tc, c, cls)) return 0;
+	SlabChunk *ch = c->free[cls];
+	c->free[cls] = ch->next;
+	c->count[cls]--;
+	return ch;
+}
+
+static void thread_cache_free(ThreadCacheAllocator *tc, void *p) {
+	if (!p) return;
+	size_t cls = slab_class_of(&tc->slab, p);
+	ThreadCache *c = 0;
+	if (cls == SLAB_LARGE || !(c = thread_cache_get(tc))) {
+		pthread_mutex_lock(&tc->lock);
+		slab_free(&tc->slab, p);
+		pthread_mutex_unlock(&tc->lock);
+		return;
+	}
+	SlabChunk *ch = p;
+	ch->next = c->free[cls];
+	c->free[cls] = ch;
+	if (++c->count[cls] > THREAD_CACHE_MAX) thread_cache_drain(tc, c, cls);
+}
+
+static void *thread_cache_realloc(
+	ThreadCacheAllocator *tc, void *old, size_t oldsz, size_t newsz
+) {
+	size_t cls = 0;
+	void *p = 0;
+	if (!old) return thread_cache_alloc_aligned(tc, newsz, ALLOC_DEFAULT_ALIGN);
+	cls = slab_class_of(&tc->slab, old);
+	if (cls != SLAB_LARGE && slab_class(newsz) == cls) return old;
+	if (cls == SLAB_LARGE && slab_class(newsz) == SLAB_LARGE) {
+		pthread_mutex_lock(&tc->lock);
+		p = slab_realloc(&tc->slab, old, oldsz, newsz);
+		pthread_mutex_unlock(&tc->lock);
+		return p;
+	}
+	if (!(p = thread_cache_alloc_aligned(tc, newsz, ALLOC_DEFAULT_ALIGN)))
+		return 0;
+	memcpy(p, old, MIN(oldsz, newsz));
+	thread_cache_free(tc, old);
+	return p;
+}
+
+static void *thread_cache_alloc_fn(Allocator *a, AllocatorOP op) {
+	ThreadCacheAllocator *tc = a->state;
+	int owns = 0;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		return thread_cache_alloc_aligned(
+			tc, op.data.alloc.size, op.data.alloc.align
+		);
+	case ALLOC_FREE:
+		thread_cache_free(tc, op.data.free.ptr);
+		return 0;
+	case ALLOC_FREE_ALL:
+		// other threads may hold chunks in their caches, use destroy instead
+		return 0;
+	case ALLOC_REALLOC:
+		return thread_cache_realloc(
+			tc, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		pthread_mutex_lock(&tc->lock);
+		owns = slab_owns(&tc->slab, op.data.owns.ptr);
+		pthread_mutex_unlock(&tc->lock);
+		return owns ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+static int thread_cache_allocator_init(Allocator *a, Allocator *backing) {
+	*a = (Allocator){0};
+	ThreadCacheAllocator *tc = 0;
+	if (!(tc = alloc_new(backing, sizeof(ThreadCacheAllocator)))) return -1;
+	*tc = (ThreadCacheAllocator){0};
+	tc->slab.backing = backing;
+	if (pthread_mutex_init(&tc->lock, 0)) {
+		alloc_free(backing, tc);
+		return -1;
+	}
+	if (pthread_key_create(&tc->key, &thread_cache_release)) {
+		pthread_mutex_destroy(&tc->lock);
+		alloc_free(backing, tc);
+		return -1;
+	}
+	*a = (Allocator){.alloc_fn = &thread_cache_alloc_fn, .state = tc};
+	return 0;
+}
+
+// must be called once every other thread stopped using the allocator, the
+// caches of threads that are still alive are released with the slab
+static void thread_cache_allocator_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &thread_cache_alloc_fn) return;
+	ThreadCacheAllocator *tc = a->state;
+	Allocator *backing = tc->slab.backing;
+	pthread_key_delete(tc->key);
+	slab_release(&tc->slab);
+	pthread_mutex_destroy(&tc->lock);
+	alloc_free(backing, tc);
+	*a = (Allocator){0};
+}
+
+#endif // THREAD_CACHE_ALLOCATOR_H
@@ -0,0 +1,342 @@
+#ifndef TLSF_ALLOCATOR_H
+#define TLSF_ALLOCATOR_H
+
+#include <stddef.h> // offsetof
+#include "allocator.h"
+
+// two level segregated fit: the first level splits the free blocks by power of
+// two, the second splits every power of two in TLSF_SL_COUNT ranges. a bitmap
+// per level finds a free block with two bit scans, so allocating and freeing
+// take the same time whatever the state of the heap
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_ALIGN_LOG2 4
+#define TLSF_ALIGN (((size_t)1) << TLSF_ALIGN_LOG2)
+// blocks smaller than this all go to the first level 0, in steps of
+// TLSF_ALIGN
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_SMALL_BLOCK (((size_t)1) << TLSF_FL_SHIFT)
+
+// blocks are smaller than 1 << TLSF_FL_MAX bytes
+#ifndef TLSF_FL_MAX
+#define TLSF_FL_MAX 38
+#endif
+#define TLSF_FL_COUNT (TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+
+// size of the regions requested from the backing allocator when the free
+// blocks run out, bigger requests get a region of their own
+#ifndef TLSF_REGION_SIZE
+#define TLSF_REGION_SIZE MIN_ALLOC_BLOCK
+#endif
+
+#define TLSF_FREE ((size_t)1)
+
+// 'size' is the size of the payload, the free flag uses its low bit. the free
+// list links overlap the payload, so they only exist while the block is free
+typedef struct TlsfBlock {
+	struct TlsfBlock *prev_phys;
+	size_t size;
+	struct TlsfBlock *next_free;
+	struct TlsfBlock *prev_free;
+} TlsfBlock;
+
+#define TLSF_HEADER offsetof(TlsfBlock, next_free)
+#define TLSF_MIN_PAYLOAD (sizeof(TlsfBlock) - TLSF_HEADER)
+
+// every region ends with a used block of size 0, so merging never walks past
+// the end of the region
+typedef struct TlsfRegion {
+	struct TlsfRegion *next;
+	size_t size; // payload of the first block when the region is empty
+} TlsfRegion;
+
+typedef struct TlsfAllocator {
+	Allocator *backing;
+	TlsfRegion *regions;
+	unsigned fl_bitmap;
+	unsigned sl_bitmap[TLSF_FL_COUNT];
+	TlsfBlock *blocks[TLSF_FL_COUNT][TLSF_SL_COUNT];
+} TlsfAllocator;
+
+static size_t tlsf_fls(size_t v) {
+	return (sizeof(size_t)*8 - 1) - __builtin_clzl(v);
+}
+
+static size_t tlsf_size(TlsfBlock *b) {
+	return b->size & ~TLSF_FREE;
+}
+
+static int tlsf_is_free(TlsfBlock *b) {
+	return b->size & TLSF_FREE;
+}
+
+static void *tlsf_payload(TlsfBlock *b) {
+	return (unsigned char *)b + TLSF_HEADER;
+}
+
+static TlsfBlock *tlsf_block_of(void *p) {
+	return (TlsfBlock *)((unsigned char *)p - TLSF_HEADER);
+}
+
+static TlsfBlock *tlsf_next_phys(TlsfBlock *b) {
+	return (TlsfBlock *)((unsigned char *)tlsf_payload(b) + tlsf_size(b));
+}
+
+static void tlsf_mapping(size_t size, size_t *fl, size_t *sl) {
+	if (size < TLSF_SMALL_BLOCK) {
+		*fl = 0;
+		*sl = size / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT);
+		return;
+	}
+	size_t f = tlsf_fls(size);
+	*sl = (size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+	*fl = f - (TLSF_FL_SHIFT - 1);
+}
+
+// rounds the size up to the next second level range, so any block of the
+// range found is big enough
+static size_t tlsf_round_up(size_t size) {
+	if (size < TLSF_SMALL_BLOCK) return size;
+	size_t step = ((size_t)1) << (tlsf_fls(size) - TLSF_SL_LOG2);
+	return (size + step - 1) & ~(step - 1);
+}
+
+// payload size for a request, 0 when it is too big
+static size_t tlsf_adjust(size_t sz) {
+	if (sz > (((size_t)1) << (TLSF_FL_MAX - 1))) return 0;
+	return MAX(alloc_align_up(sz, TLSF_ALIGN), TLSF_MIN_PAYLOAD);
+}
+
+static void tlsf_insert(TlsfAllocator *t, TlsfBlock *b) {
+	size_t fl = 0, sl = 0;
+	tlsf_mapping(tlsf_size(b), &fl, &sl);
+	b->prev_free = 0;
+	b->next_free = t->blocks[fl][sl];
+	if (b->next_free) b->next_free->prev_free = b;
+	t->blocks[fl][sl] = b;
+	t->fl_bitmap |= 1U << fl;
+	t->sl_bitmap[fl] |= 1U << sl;
+}
+
+static void tlsf_remove(TlsfAllocator *t, TlsfBlock *b) {
+	size_t fl = 0, sl = 0;
+	tlsf_mapping(tlsf_size(b), &fl, &sl);
+	if (b->prev_free) b->prev_free->next_free = b->next_free;
+	else t->blocks[fl][sl] = b->next_free;
+	if (b->next_free) b->next_free->prev_free = b->prev_free;
+	if (t->blocks[fl][sl]) return;
+	t->sl_bitmap[fl] &= ~(1U << sl);
+	if (!t->sl_bitmap[fl]) t->fl_bitmap &= ~(1U << fl);
+}
+
+// a free block of at least 'size' bytes, taken out of its list and marked used
+static TlsfBlock *tlsf_find(TlsfAllocator *t, size_t size) {
+	size_t fl = 0, sl = 0;
+	size = tlsf_round_up(size);
+	if (size >> TLSF_FL_MAX) return 0;
+	tlsf_mapping(size, &fl, &sl);
+	unsigned sl_map = t->sl_bitmap[fl] & (~0U << sl);
+	if (!sl_map) {
+		unsigned fl_map = fl + 1 < 32 ? t->fl_bitmap & (~0U << (fl + 1)) : 0;
+		if (!fl_map) return 0;
+		fl = __builtin_ctz(fl_map);
+		sl_map = t->sl_bitmap[fl];
+	}
+	sl = __builtin_ctz(sl_map);
+	TlsfBlock *b = t->blocks[fl][sl];
+	tlsf_remove(t, b);
+	b->size = tlsf_size(b);
+	return b;
+}
+
+// marks the block free, merges it with its free neighbours and lists it
+static void tlsf_release(TlsfAllocator *t, TlsfBlock *b) {
+	TlsfBlock *next = tlsf_next_phys(b);
+	b->size = tlsf_size(b);
+	if (tlsf_is_free(next)) {
+		tlsf_remove(t, next);
+		b->size += TLSF_HEADER + tlsf_size(next);
+		next = tlsf_next_phys(b);
+	}
+	if (b->prev_phys && tlsf_is_free(b->prev_phys)) {
+		TlsfBlock *prev = b->prev_phys;
+		tlsf_remove(t, prev);
+		prev->size = tlsf_size(prev) + TLSF_HEADER + tlsf_size(b);
+		b = prev;
+	}
+	next->prev_phys = b;
+	b->size |= TLSF_FREE;
+	tlsf_insert(t, b);
+}
+
+// gives the end of a used block past 'size' bytes back to the free lists
+static void tlsf_split(TlsfAllocator *t, TlsfBlock *b, size_t size) {
+	size_t bsize = tlsf_size(b);
+	if (bsize < size + TLSF_HEADER + TLSF_MIN_PAYLOAD) return;
+	TlsfBlock *rest = (TlsfBlock *)((unsigned char *)tlsf_payload(b) + size);
+	rest->prev_phys = b;
+	rest->size = bsize - size - TLSF_HEADER;
+	tlsf_next_phys(rest)->prev_phys = rest;
+	b->size = size;
+	tlsf_release(t, rest);
+}
+
+static void tlsf_region_reset(TlsfAllocator *t, TlsfRegion *r) {
+	TlsfBlock *b = (TlsfBlock *)(r + 1);
+	b->prev_phys = 0;
+	b->size = r->size;
+	TlsfBlock *end = tlsf_next_phys(b);
+	end->prev_phys = b;
+	end->size = 0;
+	b->size |= TLSF_FREE;
+	tlsf_insert(t, b);
+}
+
+static int tlsf_add_region(TlsfAllocator *t, size_t size) {
+	size_t overhead = sizeof(TlsfRegion) + 2*TLSF_HEADER;
+	size = alloc_align_up(MAX(size, TLSF_REGION_SIZE - overhead), TLSF_ALIGN);
+	if (size >> TLSF_FL_MAX) return -1;
+	TlsfRegion *r = 0;
+	if (!(r = alloc_new(t->backing, overhead + size))) return -1;
+	*r = (TlsfRegion){ .next = t->regions, .size = size };
+	t->regions = r;
+	tlsf_region_reset(t, r);
+	return 0;
+}
+
+static void *tlsf_alloc_aligned(TlsfAllocator *t, size_t sz, size_t align) {
+	size_t size = tlsf_adjust(sz);
+	TlsfBlock *b = 0;
+	if (!size) return 0;
+	if (align <= TLSF_ALIGN) {
+		if (!(b = tlsf_find(t, size))) {
+			if (tlsf_add_region(t, tlsf_round_up(size))) return 0;
+			b = tlsf_find(t, size);
+		}
+		tlsf_split(t, b, size);
+		return tlsf_payload(b);
+	}
+	// room to move the payload up to the alignment, leaving a free block
+	// before it
+	size_t gap = align + TLSF_HEADER + TLSF_MIN_PAYLOAD;
+	if (size + gap < size) return 0;
+	if (!(b = tlsf_find(t, size + gap))) {
+		if (tlsf_add_region(t, tlsf_round_up(size + gap))) return 0;
+		b = tlsf_find(t, size + gap);
+	}
+	size_t p = (size_t)tlsf_payload(b);
+	size_t aligned = alloc_align_up(p, align);
+	while (aligned != p && aligned - p < TLSF_HEADER + TLSF_MIN_PAYLOAD)
+		aligned += align;
+	if (aligned != p) {
+		TlsfBlock *a = tlsf_block_of((void *)aligned);
+		a->prev_phys = b;
+		a->size = tlsf_size(b) - (aligned - p);
+		tlsf_next_phys(a)->prev_phys = a;
+		b->size = aligned - p - TLSF_HEADER;
+		tlsf_release(t, b);
+		b = a;
+	}
+	tlsf_split(t, b, size);
+	return tlsf_payload(b);
+}
+
+static void tlsf_free(TlsfAllocator *t, void *p) {
+	if (!p) return;
+	tlsf_release(t, tlsf_block_of(p));
+}
+
+static void *tlsf_realloc(
+	TlsfAllocator *t, void *old, size_t oldsz, size_t newsz
+) {
+	if (!old) return tlsf_alloc_aligned(t, newsz, TLSF_ALIGN);
+	size_t size = tlsf_adjust(newsz);
+	TlsfBlock *b = tlsf_block_of(old);
+	TlsfBlock *next = tlsf_next_phys(b);
+	void *p = 0;
+	if (!size) return 0;
+	// grows into the next block when it is free
+	if (size > tlsf_size(b) && tlsf_is_free(next) &&
+		tlsf_size(b) + TLSF_HEADER + tlsf_size(next) >= size
+	) {
+		tlsf_remove(t, next);
+		b->size += TLSF_HEADER + tlsf_size(next);
+		tlsf_next_phys(b)->prev_phys = b;
+	}
+	if (size <= tlsf_size(b)) {
+		tlsf_split(t, b, size);
+		return old;
+	}
+	if (!(p = tlsf_alloc_aligned(t, newsz, TLSF_ALIGN))) return 0;
+	memcpy(p, old, MIN(oldsz, newsz));
+	tlsf_free(t, old);
+	return p;
+}
+
+// every region becomes one free block again, nothing goes back to the backing
+// allocator
+static void tlsf_reset(TlsfAllocator *t) {
+	t->fl_bitmap = 0;
+	memset(t->sl_bitmap, 0, sizeof(t->sl_bitmap));
+	memset(t->blocks, 0, sizeof(t->blocks));
+	for (TlsfRegion *r = t->regions; r; r = r->next) tlsf_region_reset(t, r);
+}
+
+static int tlsf_owns(TlsfAllocator *t, void *p) {
+	for (TlsfRegion *r = t->regions; r; r = r->next) {
+		if ((size_t)p - (size_t)(r + 1) < r->size + 2*TLSF_HEADER) return 1;
+	}
+	return 0;
+}
+
+static void *tlsf_alloc_fn(Allocator *a, AllocatorOP op) {
+	TlsfAllocator *t = a->state;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		return tlsf_alloc_aligned(t, op.data.alloc.size, op.data.alloc.align);
+	case ALLOC_FREE:
+		tlsf_free(t, op.data.free.ptr);
+		return 0;
+	case ALLOC_FREE_ALL:
+		tlsf_reset(t);
+		return 0;
+	case ALLOC_REALLOC:
+		return tlsf_realloc(
+			t, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		return tlsf_owns(t, op.data.owns.ptr) ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+static int tlsf_allocator_init(Allocator *a, Allocator *backing) {
+	*a = (Allocator){0};
+	TlsfAllocator *t = 0;
+	if (!(t = alloc_new(backing, sizeof(TlsfAllocator)))) return -1;
+	*t = (TlsfAllocator){0};
+	t->backing = backing;
+	*a = (Allocator){.alloc_fn = &tlsf_alloc_fn, .state = t};
+	return 0;
+}
+
+// adds a region with room for 'size' bytes, only allocations that do not fit
+// the regions call the backing allocator, so reserving up front keeps every
+// allocation and free O(1)
+static int tlsf_reserve(Allocator *a, size_t size) {
+	return tlsf_add_region((TlsfAllocator *)a->state, size);
+}
+
+static void tlsf_allocator_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &tlsf_alloc_fn) return;
+	TlsfAllocator *t = a->state;
+	for (TlsfRegion *r = 0; t->regions; t->regions = r) {
+		r = t->regions->next;
+		alloc_free(t->backing, t->regions);
+	}
+	alloc_free(t->backing, t);
+	*a = (Allocator){0};
+}
+
+#endif // TLSF_ALLOCATOR_H
@@ -0,0 +1,135 @@
+#ifndef VM_ARENA_ALLOCATOR_H
+#define VM_ARENA_ALLOCATOR_H
+
+#include "allocator.h" // first, it enables madvise in strict C11
+#include <sys/mman.h> // mmap / mprotect / madvise / munmap
+#include <unistd.h> // sysconf
+
+// pages are committed in steps of VM_ARENA_COMMIT_SIZE as the arena grows
+#ifndef VM_ARENA_COMMIT_SIZE
+#define VM_ARENA_COMMIT_SIZE (((size_t)1) << 16)
+#endif
+
+// the arena reserves one contiguous range of virtual memory up front and
+// commits it as needed, allocations never move and there is no block chain.
+// the state lives at the beginning of the reserved range
+typedef struct VMArenaAllocator {
+	unsigned char *base;
+	size_t reserved;
+	size_t committed;
+	size_t granule;
+	size_t len;
+} VMArenaAllocator;
+
+static size_t vm_arena_header_size(void) {
+	return alloc_align_up(sizeof(VMArenaAllocator), ALLOC_DEFAULT_ALIGN);
+}
+
+static int vm_arena_commit(VMArenaAllocator *v, size_t end) {
+	if (end <= v->committed) return 0;
+	if (end > v->reserved) return -1;
+	size_t newc = MIN(alloc_align_up(end, v->granule), v->reserved);
+	if (mprotect(
+		v->base + v->committed, newc - v->committed, PROT_READ | PROT_WRITE
+	)) return -1;
+	v->committed = newc;
+	return 0;
+}
+
+static void *vm_arena_alloc_aligned(
+	VMArenaAllocator *v, size_t sz, size_t align
+) {
+	if (!align) align = ALLOC_DEFAULT_ALIGN;
+	size_t off = alloc_align_up(v->len, align);
+	if (off < v->len || off + sz < off) return 0;
+	if (vm_arena_commit(v, off + sz)) return 0;
+	v->len = off + sz;
+	return v->base + off;
+}
+
+static void *vm_arena_realloc(
+	VMArenaAllocator *v, void *old, size_t oldsz, size_t newsz
+) {
+	size_t off = (size_t)old - (size_t)v->base;
+	void *p = 0;
+	// the most recent allocation grows or shrinks in place
+	if (old && off + oldsz == v->len) {
+		if (vm_arena_commit(v, off + newsz)) return 0;
+		v->len = off + newsz;
+		return old;
+	}
+	if (!(p = vm_arena_alloc_aligned(v, newsz, ALLOC_DEFAULT_ALIGN))) return 0;
+	if (old) memcpy(p, old, MIN(oldsz, newsz));
+	return p;
+}
+
+// gives the committed pages back to the OS, but keeps the ones holding the
+// state
+static void vm_arena_decommit(VMArenaAllocator *v) {
+	size_t keep = v->granule;
+	v->len = vm_arena_header_size();
+	if (v->committed <= keep) return;
+	madvise(v->base + keep, v->committed - keep, MADV_DONTNEED);
+	mprotect(v->base + keep, v->committed - keep, PROT_NONE);
+	v->committed = keep;
+}
+
+static void *vm_arena_alloc_fn(Allocator *a, AllocatorOP op) {
+	VMArenaAllocator *v = (VMArenaAllocator *)a->state;
+	switch (op.opcode) {
+	case ALLOC_ALLOC:
+		return vm_arena_alloc_aligned(v, op.data.alloc.size, op.data.alloc.align);
+	case ALLOC_FREE:
+		// free is not implemented for arena, but it is safe to call
+		return 0;
+	case ALLOC_FREE_ALL:
+		vm_arena_decommit(v);
+		return 0;
+	case ALLOC_REALLOC:
+		return vm_arena_realloc(
+			v, op.data.realloc.old, op.data.realloc.oldsz, op.data.realloc.newsz
+		);
+	case ALLOC_OWNS:
+		return (size_t)op.data.owns.ptr - (size_t)v->base < v->reserved ? a : 0;
+	default:
+		return 0;
+	}
+}
+
+// reserves 'reserve' bytes of address space, nothing is committed besides the
+// first VM_ARENA_COMMIT_SIZE bytes
+static int vm_arena_init(Allocator *a, size_t reserve) {
+	*a = (Allocator){0};
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t granule = alloc_align_up(VM_ARENA_COMMIT_SIZE, page);
+	reserve = alloc_align_up(MAX(reserve, granule), granule);
+	unsigned char *base = mmap(
+		0, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0
+	);
+	if (base == MAP_FAILED) return -1;
+	if (mprotect(base, granule, PROT_READ | PROT_WRITE)) {
+		munmap(base, reserve);
+		return -1;
+	}
+	VMArenaAllocator *v = (VMArenaAllocator *)base;
+	*v = (VMArenaAllocator){
+		.base = base,
+		.reserved = reserve,
+		.committed = granule,
+		.granule = granule,
+		.len = vm_arena_header_size(),
+	};
+	a->alloc_fn = &vm_arena_alloc_fn;
+	a->state = v;
+	return 0;
+}
+
+static int vm_arena_destroy(Allocator *a) {
+	if (!a->state || a->alloc_fn != &vm_arena_alloc_fn) return 0;
+	VMArenaAllocator *v = (VMArenaAllocator *)a->state;
+	if (munmap(v->base, v->reserved)) return -1;
+	*a = (Allocator){0};
+	return 0;
+}
+
+#endif // VM_ARENA_ALLOCATOR_H
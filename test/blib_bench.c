@@ -0,0 +1,266 @@
+#include "allocator.h"
+#include <stdint.h>
+#include <time.h>
+#include "assert.h"
+#include "malloc_allocator.h"
+#include "arena_allocator.h"
+#include "slab_allocator.h"
+#include "tlsf_allocator.h"
+#include "slice.h"
+#include "slice_sort.h"
+#include "seg_slice.h"
+
+#define BENCH_N 10000000
+#define BENCH_LATENCY_N 1000000
+#define BENCH_LATENCY_SLOTS 4096
+#define BENCH_LATENCY_BATCH 16
+#define BENCH_SORT_N 1000000
+
+// keeps the compiler from optimizing the allocations away
+static volatile size_t bench_sink;
+
+static double bench_now(void) {
+	struct timespec ts = {0};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec*1e9 + (double)ts.tv_nsec;
+}
+
+static void bench_report(const char *name, double start, size_t n) {
+	printf("%-40s %8.2f ns/op\n", name, (bench_now() - start)/(double)n);
+}
+
+static void bench_arena(Allocator *malloc_a) {
+	Allocator arena = {0};
+	double start = 0;
+	size_t sink = 0;
+	assert(!arena_init(&arena, malloc_a));
+	// warm up, so both runs reuse the same blocks
+	for (size_t i = 0; i < BENCH_N; i++) sink ^= (size_t)alloc_new(&arena, 16);
+	alloc_free_all(&arena);
+	//
+	start = bench_now();
+	for (size_t i = 0; i < BENCH_N; i++) sink ^= (size_t)alloc_new(&arena, 16);
+	bench_report("arena alloc_new 16B", start, BENCH_N);
+	alloc_free_all(&arena);
+	//
+	start = bench_now();
+	for (size_t i = 0; i < BENCH_N; i++) {
+		sink ^= (size_t)arena_alloc_fast(&arena, 16);
+	}
+	bench_report("arena arena_alloc_fast 16B", start, BENCH_N);
+	bench_sink = sink;
+	arena_destroy(&arena);
+}
+
+static void bench_slab(Allocator *malloc_a) {
+	Allocator slab = {0};
+	double start = 0;
+	void *p = 0;
+	assert(!slab_allocator_init(&slab, malloc_a));
+	//
+	start = bench_now();
+	for (size_t i = 0; i < BENCH_N; i++) {
+		p = alloc_new(&slab, 32);
+		alloc_free(&slab, p);
+	}
+	bench_report("slab alloc_new/alloc_free 32B", start, BENCH_N);
+	//
+	start = bench_now();
+	for (size_t i = 0; i < BENCH_N; i++) {
+		p = slab_alloc_fast(&slab, 32);
+		slab_free_fast(&slab, p);
+	}
+	bench_report("slab slab_alloc_fast/slab_free_fast 32B", start, BENCH_N);
+	//
+	start = bench_now();
+	for (size_t i = 0; i < BENCH_N; i++) {
+		p = alloc_new(malloc_a, 32);
+		alloc_free(malloc_a, p);
+	}
+	bench_report("malloc alloc_new/alloc_free 32B", start, BENCH_N);
+	slab_allocator_destroy(&slab);
+}
+
+SLICE_DEFINE(u32, uint32_t)
+
+static void bench_slice(Allocator *malloc_a) {
+	Slice s = {0};
+	Slice_u32 typed = {0};
+	double start = 0;
+	uint32_t v = 0, sum = 0;
+	slice_init(&s, malloc_a, sizeof(uint32_t));
+	slice_u32_init(&typed, malloc_a);
+	//
+	start = bench_now();
+	for (uint32_t i = 0; i < BENCH_N; i++) assert(!slice_append(&s, &i));
+	bench_report("slice slice_append u32", start, BENCH_N);
+	start = bench_now();
+	for (size_t i = 0; i < BENCH_N; i++) {
+		slice_get(&s, i, &v);
+		sum += v;
+	}
+	bench_report("slice slice_get u32", start, BENCH_N);
+	//
+	start = bench_now();
+	for (uint32_t i = 0; i < BENCH_N; i++) assert(!slice_u32_append(&typed, i));
+	bench_report("slice slice_u32_append", start, BENCH_N);
+	start = bench_now();
+	for (uint32_t *p = slice_u32_begin(&typed); p != slice_u32_end(&typed); p++)
+		sum += *p;
+	bench_report("slice slice_u32 pointer iteration", start, BENCH_N);
+	bench_sink = sum;
+	slice_destroy(&s);
+	slice_destroy(&typed.s);
+}
+
+static void bench_seg_slice(Allocator *malloc_a) {
+	SegSlice s = {0};
+	double start = 0;
+	uint32_t v = 0, sum = 0;
+	seg_slice_init(&s, malloc_a, sizeof(uint32_t), 0);
+	//
+	start = bench_now();
+	for (uint32_t i = 0; i < BENCH_N; i++) assert(!seg_slice_append(&s, &i));
+	bench_report("seg_slice seg_slice_append u32", start, BENCH_N);
+	start = bench_now();
+	for (size_t i = 0; i < BENCH_N; i++) {
+		seg_slice_get(&s, i, &v);
+		sum += v;
+	}
+	bench_report("seg_slice seg_slice_get u32", start, BENCH_N);
+	bench_sink = sum;
+	seg_slice_destroy(&s);
+}
+
+static int bench_cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int bench_slice_cmp_u32(void *ctx, void *a, void *b) {
+	(void)ctx;
+	return bench_cmp_u32(a, b);
+}
+
+static void bench_sort_fill(Slice *s) {
+	uint32_t seed = 1;
+	for (size_t i = 0; i < BENCH_SORT_N; i++) {
+		seed = seed*1103515245 + 12345;
+		((uint32_t *)s->base)[i] = seed;
+	}
+}
+
+static void bench_sort(Allocator *malloc_a) {
+	Slice s = {0};
+	double start = 0;
+	slice_init(&s, malloc_a, sizeof(uint32_t));
+	assert(!slice_grow_len_at(&s, BENCH_SORT_N));
+	//
+	bench_sort_fill(&s);
+	start = bench_now();
+	qsort(s.base, BENCH_SORT_N, sizeof(uint32_t), &bench_cmp_u32);
+	bench_report("qsort u32", start, BENCH_SORT_N);
+	bench_sort_fill(&s);
+	start = bench_now();
+	slice_sort(&s, 0, &bench_slice_cmp_u32);
+	bench_report("slice slice_sort u32", start, BENCH_SORT_N);
+	bench_sort_fill(&s);
+	start = bench_now();
+	assert(!slice_sort_stable(&s, 0, &bench_slice_cmp_u32));
+	bench_report("slice slice_sort_stable u32", start, BENCH_SORT_N);
+	bench_sort_fill(&s);
+	start = bench_now();
+	assert(!slice_radix_sort(&s, 0, sizeof(uint32_t), 0));
+	bench_report("slice slice_radix_sort u32", start, BENCH_SORT_N);
+	slice_destroy(&s);
+}
+
+static int bench_cmp(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// median cost of reading the clock twice, taken off every timed batch
+static double bench_timer_overhead(void) {
+	static double ns[10000];
+	double start = 0;
+	for (size_t i = 0; i < sizeof(ns)/sizeof(ns[0]); i++) {
+		start = bench_now();
+		ns[i] = bench_now() - start;
+	}
+	qsort(ns, sizeof(ns)/sizeof(ns[0]), sizeof(ns[0]), &bench_cmp);
+	return ns[sizeof(ns)/sizeof(ns[0])/2];
+}
+
+// a random mix of allocations and frees from 16 bytes to 32 KiB, spread over
+// every power of two and freed in random order, so the free space breaks in
+// holes of every size. reading the clock costs as much as an allocation, so
+// batches of BENCH_LATENCY_BATCH calls are timed, the timer overhead is taken
+// off and the per call figure is the batch mean. a stall still shows in the
+// tail, divided by the batch size. a null name is a warm up run that touches
+// the pages and reports nothing
+static void bench_latency(const char *name, Allocator *a, double overhead) {
+	static void *slots[BENCH_LATENCY_SLOTS];
+	static double ns[BENCH_LATENCY_N/BENCH_LATENCY_BATCH];
+	size_t n = sizeof(ns)/sizeof(ns[0]);
+	uint32_t seed = 1;
+	double start = 0;
+	for (size_t i = 0; i < n; i++) {
+		start = bench_now();
+		for (size_t j = 0; j < BENCH_LATENCY_BATCH; j++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			size_t k = seed % BENCH_LATENCY_SLOTS;
+			size_t sz = (size_t)16 << ((seed >> 12) % 11);
+			sz += (seed >> 16) % sz;
+			if (slots[k]) {
+				alloc_free(a, slots[k]);
+				slots[k] = 0;
+			} else {
+				slots[k] = alloc_new(a, sz);
+			}
+		}
+		ns[i] = MAX(bench_now() - start - overhead, 0)/BENCH_LATENCY_BATCH;
+	}
+	for (size_t k = 0; k < BENCH_LATENCY_SLOTS; k++) {
+		alloc_free(a, slots[k]);
+		slots[k] = 0;
+	}
+	if (!name) return;
+	qsort(ns, n, sizeof(ns[0]), &bench_cmp);
+	printf(
+		"%-40s p50 %5.0f ns  p99 %5.0f ns  p99.9 %5.0f ns  max %7.0f ns\n",
+		name,
+		ns[n/2],
+		ns[n/100*99],
+		ns[n/1000*999],
+		ns[n-1]
+	);
+}
+
+static void bench_tlsf(Allocator *malloc_a) {
+	Allocator tlsf = {0};
+	assert(!tlsf_allocator_init(&tlsf, malloc_a));
+	// the worst case is only bounded once no region has to be added
+	assert(!tlsf_reserve(&tlsf, BENCH_LATENCY_SLOTS*16384));
+	double overhead = bench_timer_overhead();
+	bench_latency(0, &tlsf, overhead);
+	bench_latency(0, malloc_a, overhead);
+	bench_latency("tlsf alloc_new/alloc_free latency", &tlsf, overhead);
+	bench_latency("malloc alloc_new/alloc_free latency", malloc_a, overhead);
+	tlsf_allocator_destroy(&tlsf);
+}
+
+int main(void) {
+	Allocator malloc_a = {0};
+	assert(!malloc_allocator_init(&malloc_a));
+	//
+	bench_arena(&malloc_a);
+	bench_slab(&malloc_a);
+	bench_tlsf(&malloc_a);
+	bench_slice(&malloc_a);
+	bench_seg_slice(&malloc_a);
+	bench_sort(&malloc_a);
+	return 0;
+}
@@ -1,13 +1,26 @@
 #include "testing.h"
+#include <stdint.h>
 #include "arena_allocator.h"
 #include "heap_allocator.h"
 #include "malloc_allocator.h"
 #include "testing.h"
 #include "bytes.h"
 #include "slice.h"
+#include "slice_sort.h"
+#include "seg_slice.h"
 #include "error.h"
 #include "io.h"
 #include "fmt.h"
+#include "slab_allocator.h"
+#include "vm_arena_allocator.h"
+#include "thread_cache_allocator.h"
+#include "concurrent_arena_allocator.h"
+#include "stats_allocator.h"
+#include "tlsf_allocator.h"
+#include "fixed_allocator.h"
+#include "compose_allocator.h"
+#include "hugepage_allocator.h"
+#include "budget_allocator.h"
 
 static void test_arena(testing_t *t) {
 	Allocator arena = {0};
@@ -31,6 +44,15 @@ static void test_arena(testing_t *t) {
 	memset(p3+sz, 2, sz);
 	testing_expect(t, bytes_is((void *)p3, 1, sz));
 	testing_expect(t, bytes_is((void *)p3+sz, 2, sz));
+	// unless the allocation is the most recent one and the block has room for
+	// it, then it grows or shrinks in place
+	char *p5 = alloc_new(&arena, 16);
+	testing_expect(t, p5);
+	memset(p5, 3, 16);
+	testing_expect(t, alloc_realloc(&arena, p5, 16, 1024) == p5);
+	testing_expect(t, alloc_realloc(&arena, p5, 1024, 8) == p5);
+	testing_expect(t, alloc_new(&arena, 8) == p5+16);
+	testing_expect(t, bytes_is((void *)p5, 3, 8));
 	// arena free all will free all blocks, with the exception of the first
 	// block, which will have the length set to 0, allowing deterministic reusage
 	// without syscalls
@@ -45,6 +67,331 @@ static void test_arena(testing_t *t) {
 	arena_destroy(&arena);
 }
 
+static void test_arena_mark(testing_t *t) {
+	Allocator arena = {0};
+	testing_expect(t, !arena_init(&arena, t->heap));
+	char *p = alloc_new(&arena, 64);
+	testing_expect(t, p);
+	memset(p, 1, 64);
+	// scratch memory nested inside a long lived arena
+	ArenaMark m = arena_mark(&arena);
+	char *scratch = alloc_new(&arena, 128);
+	testing_expect(t, scratch);
+	ArenaMark m2 = arena_mark(&arena);
+	// spills into new blocks, which are freed on restore
+	testing_expect(t, alloc_new(&arena, MIN_ALLOC_BLOCK));
+	testing_expect(t, alloc_new(&arena, MIN_ALLOC_BLOCK));
+	arena_restore(&arena, m2);
+	testing_expect(t, alloc_new(&arena, 8) == scratch+128);
+	arena_restore(&arena, m);
+	testing_expect(t, alloc_new(&arena, 8) == scratch);
+	testing_expect(t, bytes_is((void *)p, 1, 64));
+	// restoring a mark of an empty arena is like free all
+	Allocator arena2 = {0};
+	testing_expect(t, !arena_init(&arena2, t->heap));
+	ArenaMark m3 = arena_mark(&arena2);
+	char *q = alloc_new(&arena2, 8);
+	testing_expect(t, q);
+	testing_expect(t, alloc_new(&arena2, MIN_ALLOC_BLOCK));
+	arena_restore(&arena2, m3);
+	testing_expect(t, alloc_new(&arena2, 8) == q);
+	arena_destroy(&arena2);
+	arena_destroy(&arena);
+}
+
+static void test_arena_retention(testing_t *t) {
+	Allocator stats = {0}, arena = {0};
+	StatsAllocator stats_state = {0};
+	AllocatorStats st = {0};
+	size_t big = ((size_t)64) << 20;
+	testing_expect(t, !stats_allocator_init(&stats, &stats_state, t->heap));
+	testing_expect(t, !arena_init(&arena, &stats));
+	// keep the largest block, a request that spilled into a big block does not
+	// allocate it again
+	arena_set_retention(&arena, ARENA_RETAIN_LARGEST, 0);
+	testing_expect(t, alloc_new(&arena, 100));
+	char *p = alloc_new(&arena, big);
+	testing_expect(t, p);
+	alloc_free_all(&arena);
+	stats_allocator_snapshot(&stats, &st);
+	size_t allocs = st.allocs;
+	testing_expect(t, alloc_new(&arena, big) == p);
+	stats_allocator_snapshot(&stats, &st);
+	testing_expect(t, st.allocs == allocs);
+	// keep up to N bytes of blocks on a free list
+	arena_set_retention(&arena, ARENA_RETAIN_BYTES, 3*MIN_ALLOC_BLOCK);
+	alloc_free_all(&arena);
+	for (size_t i = 0; i < 2; i++) {
+		for (size_t j = 0; j < 3; j++) {
+			testing_expect(t, alloc_new(&arena, MIN_ALLOC_BLOCK - 64));
+		}
+		stats_allocator_snapshot(&stats, &st);
+		if (i) testing_expect(t, st.allocs == allocs);
+		allocs = st.allocs;
+		alloc_free_all(&arena);
+	}
+	// one block sized to the bytes used before free all
+	arena_set_retention(&arena, ARENA_RETAIN_HIGH_WATER, 0);
+	for (size_t i = 0; i < 3; i++) {
+		for (size_t j = 0; j < 5; j++) {
+			testing_expect(t, alloc_new(&arena, MIN_ALLOC_BLOCK));
+		}
+		stats_allocator_snapshot(&stats, &st);
+		if (i == 2) testing_expect(t, st.allocs == allocs);
+		allocs = st.allocs;
+		alloc_free_all(&arena);
+	}
+	arena_destroy(&arena);
+	stats_allocator_snapshot(&stats, &st);
+	testing_expect(t, st.live_bytes == 0);
+	stats_allocator_destroy(&stats);
+}
+
+static void test_arena_waste(testing_t *t) {
+	Allocator arena = {0};
+	testing_expect(t, !arena_init(&arena, t->heap));
+	char *p = alloc_new(&arena, MIN_ALLOC_BLOCK/2);
+	testing_expect(t, p);
+	// oversized requests do not take the place of the last block
+	char *big = alloc_new(&arena, MIN_ALLOC_BLOCK*2);
+	testing_expect(t, big);
+	testing_expect(t, alloc_new(&arena, 64) == p + MIN_ALLOC_BLOCK/2);
+	// only the room kept for the alignment of the dedicated block
+	testing_expect(t, arena_wasted_bytes(&arena) < ALLOC_DEFAULT_ALIGN);
+	// the tail of the first block serves small requests after it is replaced
+	char *q = alloc_new(&arena, MIN_ALLOC_BLOCK*3/4);
+	testing_expect(t, q);
+	char *r = alloc_new(&arena, MIN_ALLOC_BLOCK*3/8);
+	testing_expect(t, r > p && r < p + MIN_ALLOC_BLOCK);
+	testing_expect(t, arena_wasted_bytes(&arena) < ALLOC_DEFAULT_ALIGN);
+	// restoring a mark gives back the dedicated blocks allocated after it
+	ArenaMark m = arena_mark(&arena);
+	testing_expect(t, alloc_new(&arena, MIN_ALLOC_BLOCK*2));
+	arena_restore(&arena, m);
+	testing_expect(t, alloc_new(&arena, 8) == q + MIN_ALLOC_BLOCK*3/4);
+	alloc_free_all(&arena);
+	testing_expect(t, arena_wasted_bytes(&arena) == 0);
+	testing_expect(t, alloc_new(&arena, 8));
+	arena_destroy(&arena);
+}
+
+static void test_arena_stats(testing_t *t) {
+	Allocator arena = {0};
+	ArenaStats st = {0};
+	testing_expect(t, !arena_init(&arena, t->heap));
+	arena_stats(&arena, &st);
+	testing_expect(t, st.blocks == 0 && st.committed_bytes == 0);
+	char *p = arena_alloc_fast(&arena, 100);
+	testing_expect(t, p);
+	testing_expect(t, alloc_new(&arena, MIN_ALLOC_BLOCK - 64));
+	arena_stats(&arena, &st);
+	testing_expect(t, st.blocks == 2);
+	testing_expect(t, st.committed_bytes >= 2*MIN_ALLOC_BLOCK);
+	testing_expect(t, st.used_bytes == 100 + MIN_ALLOC_BLOCK - 64);
+	testing_expect(t, st.peak_bytes == st.used_bytes);
+	// the peak survives restoring a mark, until free all
+	ArenaMark m = arena_mark(&arena);
+	testing_expect(t, alloc_new(&arena, MIN_ALLOC_BLOCK*4));
+	arena_restore(&arena, m);
+	arena_stats(&arena, &st);
+	testing_expect(t, st.blocks == 2);
+	testing_expect(t, st.used_bytes == 100 + MIN_ALLOC_BLOCK - 64);
+	testing_expect(t, st.peak_bytes >= st.used_bytes + MIN_ALLOC_BLOCK*4);
+	alloc_free_all(&arena);
+	arena_stats(&arena, &st);
+	testing_expect(t, st.blocks == 1);
+	testing_expect(t, st.used_bytes == 0 && st.peak_bytes == 0);
+	testing_expect(t, st.wasted_bytes == 0);
+	arena_destroy(&arena);
+}
+
+static void test_alloc_fast(testing_t *t) {
+	Allocator arena = {0}, slab = {0};
+	testing_expect(t, !arena_init(&arena, t->heap));
+	testing_expect(t, !slab_allocator_init(&slab, t->heap));
+	// typed entry points share the state of the dynamic Allocator path
+	char *p = arena_alloc_fast(&arena, 3);
+	testing_expect(t, p);
+	char *p2 = alloc_new(&arena, 3);
+	testing_expect(t, p2 == p + ALLOC_DEFAULT_ALIGN);
+	char *p3 = arena_alloc_fast(&arena, 8);
+	testing_expect(t, p3 == p2 + ALLOC_DEFAULT_ALIGN);
+	testing_expect(t, arena_alloc_fast(&arena, MIN_ALLOC_BLOCK));
+	void *q = slab_alloc_fast(&slab, 32);
+	testing_expect(t, q);
+	alloc_free(&slab, q);
+	testing_expect(t, alloc_new(&slab, 32) == q);
+	slab_free_fast(&slab, q);
+	slab_allocator_destroy(&slab);
+	arena_destroy(&arena);
+}
+
+// fails every allocation past 'limit'
+typedef struct BatchTestBacking {
+	Allocator *heap;
+	size_t calls;
+	size_t limit;
+} BatchTestBacking;
+
+static void *batch_test_backing_fn(Allocator *a, AllocatorOP op) {
+	BatchTestBacking *b = a->state;
+	if (op.opcode == ALLOC_ALLOC && b->calls++ >= b->limit) return 0;
+	return b->heap->alloc_fn(b->heap, op);
+}
+
+static void test_alloc_batch(testing_t *t) {
+	Allocator arena = {0}, slab = {0}, malloc_a = {0};
+	void *ptrs[1000] = {0};
+	testing_expect(t, !arena_init(&arena, t->heap));
+	testing_expect(t, !slab_allocator_init(&slab, t->heap));
+	testing_expect(t, !malloc_allocator_init(&malloc_a));
+	// the arena serves the whole batch with a single bump
+	testing_expect(t, !alloc_new_batch(&arena, 24, 1000, ptrs));
+	for (size_t i = 1; i < 1000; i++) {
+		testing_expect(t, (char *)ptrs[i] == (char *)ptrs[i-1] + 32);
+	}
+	alloc_free_batch(&arena, ptrs, 1000);
+	// the slab pops and pushes its free lists without a dispatch per pointer
+	testing_expect(t, !alloc_new_batch(&slab, 24, 1000, ptrs));
+	for (size_t i = 0; i < 1000; i++) memset(ptrs[i], 1, 24);
+	alloc_free_batch(&slab, ptrs, 1000);
+	// the freed chunks are popped back in one pass
+	testing_expect(t, !alloc_new_batch(&slab, 24, 1000, ptrs));
+	alloc_free_batch(&slab, ptrs, 1000);
+	// a failed batch is rolled back and not retried one pointer at a time,
+	// the state, one block and the page map nodes of the block fit the limit
+	BatchTestBacking bb = { .heap = t->heap, .limit = 4 };
+	Allocator backing = { .alloc_fn = &batch_test_backing_fn, .state = &bb };
+	Allocator small = {0};
+	void *many[3000] = {0};
+	size_t per_block = (SLAB_BLOCK_SIZE - slab_header_size()) / 32;
+	testing_expect(t, !slab_allocator_init(&small, &backing));
+	testing_expect(t, alloc_new_batch(&small, 24, 3000, many) == -1);
+	testing_expect(t, bb.calls == 5);
+	testing_expect(t, !alloc_new_batch(&small, 24, per_block, many));
+	testing_expect(t, bb.calls == 5);
+	alloc_free_batch(&small, many, per_block);
+	slab_allocator_destroy(&small);
+	// allocators without native batches fall back to one call per pointer
+	Allocator *allocators[] = { &malloc_a, t->heap };
+	for (size_t i = 0; i < sizeof(allocators)/sizeof(allocators[0]); i++) {
+		testing_expect(t, !alloc_new_batch(allocators[i], 24, 1000, ptrs));
+		for (size_t j = 0; j < 1000; j++) memset(ptrs[j], 1, 24);
+		alloc_free_batch(allocators[i], ptrs, 1000);
+	}
+	slab_allocator_destroy(&slab);
+	arena_destroy(&arena);
+}
+
+static void test_vm_arena(testing_t *t) {
+	Allocator arena = {0};
+	// reserving address space is cheap, pages are only committed when used
+	testing_expect(t, !vm_arena_init(&arena, ((size_t)4) << 30));
+	char *p = alloc_new(&arena, 100);
+	testing_expect(t, p);
+	// there are no blocks, allocations are contiguous no matter the size
+	size_t sz = ((size_t)10) << 20;
+	char *p2 = alloc_new(&arena, sz);
+	testing_expect(t, p2 == p + alloc_align_up(100, ALLOC_DEFAULT_ALIGN));
+	memset(p2, 1, sz);
+	char *p3 = alloc_new(&arena, sz);
+	testing_expect(t, p3 == p2 + sz);
+	// and the most recent allocation can always grow in place
+	testing_expect(t, alloc_realloc(&arena, p3, sz, sz*4) == p3);
+	memset(p3, 2, sz*4);
+	testing_expect(t, bytes_is((void *)p2, 1, sz));
+	// free all decommits the pages, the addresses are reused
+	alloc_free_all(&arena);
+	char *p4 = alloc_new(&arena, 100);
+	testing_expect(t, p4 == p);
+	// past the pages holding the state, decommitted memory comes back zeroed
+	char *p5 = alloc_new(&arena, sz);
+	testing_expect(t, p5);
+	testing_expect(t, bytes_is((void *)p5+VM_ARENA_COMMIT_SIZE, 0, sz/2));
+	// allocations past the reserved range fail cleanly
+	testing_expect(t, !alloc_new(&arena, ((size_t)8) << 30));
+	testing_expect(t, !vm_arena_destroy(&arena));
+}
+
+typedef struct {
+	Allocator *arena;
+	size_t id;
+	size_t *ptrs[20000];
+} ConcurrentArenaWork;
+
+static void *concurrent_arena_worker(void *ctx) {
+	ConcurrentArenaWork *w = ctx;
+	for (size_t i = 0; i < 20000; i++) {
+		if (!(w->ptrs[i] = alloc_new(w->arena, 24 + (i % 3)*100))) break;
+		w->ptrs[i][0] = w->id;
+		w->ptrs[i][1] = i;
+	}
+	return 0;
+}
+
+static void test_concurrent_arena(testing_t *t) {
+	Allocator arena = {0};
+	pthread_t threads[4] = {0};
+	ConcurrentArenaWork *work = 0;
+	testing_expect(t, !concurrent_arena_init(&arena, t->heap));
+	testing_expect(t, (work = alloc_new(t->arena, sizeof(*work)*4)));
+	// every thread bump allocates from the same arena
+	for (size_t i = 0; i < 4; i++) {
+		work[i].arena = &arena;
+		work[i].id = i;
+		testing_expect(
+			t, !pthread_create(&threads[i], 0, &concurrent_arena_worker, &work[i])
+		);
+	}
+	for (size_t i = 0; i < 4; i++) testing_expect(t, !pthread_join(threads[i], 0));
+	// no allocation overlaps another one
+	for (size_t i = 0; i < 4; i++) {
+		for (size_t j = 0; j < 20000; j++) {
+			testing_expect(t, work[i].ptrs[j]);
+			testing_expect(t, work[i].ptrs[j][0] == i && work[i].ptrs[j][1] == j);
+		}
+	}
+	void *p = alloc_new_aligned(&arena, 10, 64);
+	testing_expect(t, p && !((size_t)p % 64));
+	// the thread that grows the arena gets the start of the new block
+	ConcurrentArenaAllocator *ca = arena.state;
+	p = alloc_new(&arena, MIN_ALLOC_BLOCK*2);
+	ConcurrentArenaBlock *b = atomic_load(&ca->last_block);
+	testing_expect(t, p == b->base && b->cap == MIN_ALLOC_BLOCK*2);
+	testing_expect(t, atomic_load(&b->len) == MIN_ALLOC_BLOCK*2);
+	// free all keeps the first block, as the arena allocator does
+	alloc_free_all(&arena);
+	testing_expect(t, alloc_new(&arena, 8));
+	concurrent_arena_destroy(&arena);
+}
+
+static void test_aligned_alloc(testing_t *t) {
+	Allocator malloc_a = {0}, arena = {0}, slab = {0};
+	testing_expect(t, !malloc_allocator_init(&malloc_a));
+	testing_expect(t, !arena_init(&arena, t->heap));
+	testing_expect(t, !slab_allocator_init(&slab, t->heap));
+	// every allocation gets at least ALLOC_DEFAULT_ALIGN, even after odd sizes
+	testing_expect(t, alloc_new(&arena, 1));
+	void *p = alloc_new(&arena, 8);
+	testing_expect(t, p && !((size_t)p % ALLOC_DEFAULT_ALIGN));
+	// alloc_new_aligned puts hot structures on cache line boundaries
+	Allocator *allocators[] = { &malloc_a, &arena, &slab, t->heap };
+	for (size_t i = 0; i < sizeof(allocators)/sizeof(allocators[0]); i++) {
+		void *o = alloc_new(allocators[i], 3);
+		testing_expect(t, o);
+		void *q = alloc_new_aligned(allocators[i], 100, 64);
+		testing_expect(t, q && !((size_t)q % 64));
+		void *r = alloc_new_aligned(allocators[i], 10, 4096);
+		testing_expect(t, r && !((size_t)r % 4096));
+		if (allocators[i] == &arena) continue;
+		alloc_free(allocators[i], o);
+		alloc_free(allocators[i], q);
+		alloc_free(allocators[i], r);
+	}
+	slab_allocator_destroy(&slab);
+	arena_destroy(&arena);
+}
+
 static void test_heap_allocator(testing_t *t) {
 	Allocator ha = {0};
 	// for now, heap allocator is a wrapper over the backing allocator, in this
@@ -80,6 +427,447 @@ static void test_heap_allocator(testing_t *t) {
 	// message if 'BLIB_DEBUG' is defined
 	// alloc_free(&ha, ptr2);
 	heap_allocator_destroy(&ha);
+	// tracking is indexed by pointer, so it stays fast with many allocations
+	testing_expect(t, !heap_allocator_init(&ha, t->heap));
+	void **ptrs = 0;
+	size_t n = 100000;
+	testing_expect(t, (ptrs = alloc_new(t->arena, n*sizeof(void *))));
+	for (size_t i = 0; i < n; i++) {
+		testing_expect(t, (ptrs[i] = alloc_new(&ha, 8)));
+	}
+	for (size_t i = 0; i < n; i += 2) {
+		testing_expect(t, (ptrs[i] = alloc_realloc(&ha, ptrs[i], 8, 16)));
+	}
+	for (size_t i = 1; i < n; i++) alloc_free(&ha, ptrs[i]);
+#ifdef BLIB_DEBUG
+	testing_expect(t, !heap_allocator_get_report(&ha, &r));
+	testing_expect(t, r.n_leaks == 1);
+	testing_expect(t, r.leak_bytes == 16);
+#endif
+	alloc_free(&ha, ptrs[0]);
+	heap_allocator_destroy(&ha);
+#ifdef BLIB_DEBUG
+	// allocations are aggregated by call site and can be exported as a profile
+	testing_expect(t, !heap_allocator_init(&ha, t->heap));
+	int line = __LINE__ + 2;
+	for (size_t i = 0; i < 10; i++) {
+		testing_expect(t, (ptrs[i] = alloc_new(&ha, 100)));
+	}
+	for (size_t i = 0; i < 4; i++) alloc_free(&ha, ptrs[i]);
+	testing_expect(t, !heap_allocator_get_report(&ha, &r));
+	Buffer profile = {0};
+	Writer pw = {0};
+	char expected[512] = {0};
+	testing_expect(t, !buffer_init(&profile, t->arena, sizeof(char)));
+	testing_expect(t, 0 < heap_allocator_profile_write(
+		&r, HEAP_PROFILE_LIVE_BYTES, buffer_as_writer(&profile, &pw)
+	));
+	int elen = snprintf(expected, sizeof(expected), "%s:%d 600\n", __FILE__, line);
+	testing_expect(t, slice_len(&profile.slice) == (size_t)elen);
+	testing_expect(
+		t, bytes_eq((void *)profile.slice.base, (void *)expected, elen)
+	);
+	for (size_t i = 4; i < 10; i++) alloc_free(&ha, ptrs[i]);
+	heap_allocator_destroy(&ha);
+	// in sampling mode only about 1 in N allocations is tracked and the report
+	// extrapolates from them
+	testing_expect(t, !heap_allocator_init(&ha, t->heap));
+	heap_allocator_set_sampling(&ha, 16);
+	for (size_t i = 0; i < n; i++) {
+		testing_expect(t, (ptrs[i] = alloc_new(&ha, 32)));
+	}
+	for (size_t i = 0; i < n/2; i++) alloc_free(&ha, ptrs[i]);
+	testing_expect(t, !heap_allocator_get_report(&ha, &r));
+	testing_expect(t, r.sample_rate == 16);
+	testing_expect(t, r.n_allocs > n*8/10 && r.n_allocs < n*12/10);
+	testing_expect(t, r.n_leaks > n/2*8/10 && r.n_leaks < n/2*12/10);
+	testing_expect(t, r.leak_bytes == r.n_leaks*32);
+	for (size_t i = n/2; i < n; i++) alloc_free(&ha, ptrs[i]);
+	// the records of freed pointers are reused, they do not pile up
+	HeapDebugAllocator *hd = ha.state;
+	size_t records = slice_len(&hd->allocs);
+	for (size_t i = 0; i < n*4; i++) {
+		testing_expect(t, (ptrs[0] = alloc_new(&ha, 32)));
+		alloc_free(&ha, ptrs[0]);
+	}
+	testing_expect(t, slice_len(&hd->allocs) == records);
+	heap_allocator_destroy(&ha);
+#endif
+}
+
+static void test_slab_allocator(testing_t *t) {
+	Allocator slab = {0};
+	testing_expect(t, !slab_allocator_init(&slab, t->heap));
+	// small allocations are served from per size class free lists
+	char *p = alloc_new(&slab, 24);
+	testing_expect(t, p);
+	memset(p, 1, 24);
+	alloc_free(&slab, p);
+	// a freed chunk is the first one to be reused by its size class
+	char *p2 = alloc_new(&slab, 32);
+	testing_expect(t, p2 == p);
+	// the free list link lived in the chunk, the contents are not kept
+	memset(p2, 1, 32);
+	// realloc stays in place while the new size fits in the same class
+	testing_expect(t, alloc_realloc(&slab, p2, 32, 20) == p2);
+	char *p3 = alloc_realloc(&slab, p2, 20, 100);
+	testing_expect(t, p3 && p3 != p2);
+	testing_expect(t, bytes_is((void *)p3, 1, 20));
+	// big allocations go to the backing allocator
+	size_t sz = ((size_t)1) << 20;
+	char *p4 = alloc_new(&slab, sz);
+	testing_expect(t, p4);
+	memset(p4, 2, sz);
+	char *p5 = alloc_realloc(&slab, p4, sz, sz*2);
+	testing_expect(t, p5 && alloc_owns(&slab, p5));
+	testing_expect(t, bytes_is((void *)p5, 2, sz));
+	// they are told apart from chunks by the page map, not by their address
+	char *p6 = alloc_new(&slab, sz);
+	testing_expect(t, p6 && alloc_owns(&slab, p6));
+	memset(p6, 3, sz);
+	char *p7 = alloc_realloc(&slab, p6, sz, 100);
+	testing_expect(t, p7 && p7 != p6 && alloc_owns(&slab, p7));
+	testing_expect(t, bytes_is((void *)p7, 3, 100));
+	alloc_free(&slab, p7);
+	alloc_free(&slab, p5);
+	alloc_free(&slab, p3);
+	// chunks carry no header, a 16 byte class packs them 16 bytes apart
+	char *c1 = alloc_new(&slab, 16), *c2 = alloc_new(&slab, 16);
+	testing_expect(t, c1 && c2 - c1 == 16);
+	char *c3 = alloc_new_aligned(&slab, 100, 4096);
+	testing_expect(t, c3 && !((size_t)c3 % 4096) && alloc_owns(&slab, c3));
+	alloc_free(&slab, c3);
+	alloc_free(&slab, c2);
+	alloc_free(&slab, c1);
+	for (int i = 0; i < 10000; i++) testing_expect(t, alloc_new(&slab, i%300));
+	// free all gives every block back to the backing allocator
+	alloc_free_all(&slab);
+	testing_expect(t, alloc_new(&slab, 8));
+	slab_allocator_destroy(&slab);
+}
+
+static void *thread_cache_worker(void *ctx) {
+	Allocator *a = ctx;
+	void *ptrs[256] = {0};
+	for (size_t i = 0; i < 100000; i++) {
+		size_t j = (i*7919) % 256;
+		if (ptrs[j]) {
+			if (*(size_t *)ptrs[j] != j) return (void *)1;
+			alloc_free(a, ptrs[j]);
+		}
+		if (!(ptrs[j] = alloc_new(a, 8 + (i % 600)))) return (void *)1;
+		*(size_t *)ptrs[j] = j;
+	}
+	for (size_t j = 0; j < 256; j++) alloc_free(a, ptrs[j]);
+	return 0;
+}
+
+static void test_tlsf_allocator(testing_t *t) {
+	Allocator tlsf = {0};
+	char *p[512] = {0};
+	size_t sz[512] = {0};
+	testing_expect(t, !tlsf_allocator_init(&tlsf, t->heap));
+	testing_expect(t, !tlsf_reserve(&tlsf, ((size_t)1) << 20));
+	// a freed block is merged with its free neighbours and reused
+	char *a = alloc_new(&tlsf, 100);
+	char *b = alloc_new(&tlsf, 100);
+	char *c = alloc_new(&tlsf, 100);
+	testing_expect(t, a && b && c);
+	alloc_free(&tlsf, a);
+	alloc_free(&tlsf, b);
+	char *d = alloc_new(&tlsf, 200);
+	testing_expect(t, d == a);
+	// realloc grows in place into the free block after it
+	memset(c, 3, 100);
+	testing_expect(t, alloc_realloc(&tlsf, c, 100, 5000) == c);
+	testing_expect(t, bytes_is((void *)c, 3, 100));
+	testing_expect(t, alloc_realloc(&tlsf, c, 5000, 50) == c);
+	char *e = alloc_new_aligned(&tlsf, 100, 4096);
+	testing_expect(t, e && !((size_t)e % 4096));
+	alloc_free(&tlsf, e);
+	alloc_free(&tlsf, c);
+	alloc_free(&tlsf, d);
+	// mixed sizes, past the reserved region
+	unsigned seed = 1;
+	for (int i = 0; i < 20000; i++) {
+		seed = seed*1103515245 + 12345;
+		size_t k = (seed >> 8) % 512;
+		if (p[k]) {
+			testing_expect(t, bytes_is((void *)p[k], (unsigned char)k, sz[k]));
+			alloc_free(&tlsf, p[k]);
+			p[k] = 0;
+			continue;
+		}
+		sz[k] = (seed >> 4) % (k < 8 ? 300000 : 2000);
+		testing_expect(t, (p[k] = alloc_new(&tlsf, sz[k])));
+		memset(p[k], (unsigned char)k, sz[k]);
+	}
+	// free all keeps the regions, a big allocation still fits in the first one
+	alloc_free_all(&tlsf);
+	testing_expect(t, alloc_new(&tlsf, (((size_t)1) << 20) - 1024));
+	tlsf_allocator_destroy(&tlsf);
+}
+
+static void test_compose_allocator(testing_t *t) {
+	Allocator fixed = {0}, fallback = {0};
+	_Alignas(16) char buf[1024];
+	testing_expect(t, fixed_allocator_init(&fixed, buf, 8));
+	testing_expect(t, !fixed_allocator_init(&fixed, buf, sizeof(buf)));
+	testing_expect(t, !fallback_allocator_init(
+		&fallback, t->heap, &fixed, t->heap
+	));
+	// the stack buffer first, the heap once it is full
+	char *p = alloc_new(&fallback, 256);
+	testing_expect(t, alloc_owns(&fixed, p) && !alloc_owns(&fixed, &fixed));
+	memset(p, 1, 256);
+	char *q = alloc_new(&fallback, 2048);
+	testing_expect(t, q && !alloc_owns(&fixed, q));
+	testing_expect(t, alloc_owns(&fallback, p));
+	// growing past the buffer moves the allocation to the heap
+	char *r = alloc_new(&fallback, 100);
+	testing_expect(t, alloc_owns(&fixed, r));
+	memset(r, 2, 100);
+	char *r2 = alloc_realloc(&fallback, r, 100, 4096);
+	testing_expect(t, r2 && !alloc_owns(&fixed, r2));
+	testing_expect(t, bytes_is((void *)r2, 2, 100));
+	// frees reach the allocator that owns the pointer, the heap would abort
+	// in debug builds otherwise
+	alloc_free(&fallback, p);
+	alloc_free(&fallback, q);
+	alloc_free(&fallback, r2);
+	fallback_allocator_destroy(&fallback);
+	// a free gives the space back once, the stale pointer no longer matches
+	FixedAllocator *f = fixed.state;
+	alloc_free_all(&fixed);
+	char *a1 = alloc_new(&fixed, 64), *a2 = alloc_new(&fixed, 64);
+	alloc_free(&fixed, a2);
+	testing_expect(t, f->last == f->cap && f->base + f->len == (void *)a2);
+	char *a3 = alloc_new(&fixed, 16);
+	// shrinking an older allocation keeps it in place
+	testing_expect(t, a3 == a2 && alloc_realloc(&fixed, a1, 64, 32) == a1);
+	char *a4 = alloc_realloc(&fixed, a1, 32, 128);
+	testing_expect(t, a4 && a4 != a1);
+	alloc_free(&fixed, a2);
+	testing_expect(t, f->base + f->len > (unsigned char *)a4);
+	//
+	Allocator slab = {0}, seg = {0};
+	testing_expect(t, !slab_allocator_init(&slab, t->heap));
+	testing_expect(t, !segregator_allocator_init(
+		&seg, t->heap, 128, &slab, t->heap
+	));
+	char *s1 = alloc_new(&seg, 64);
+	char *s2 = alloc_new(&seg, 1000);
+	testing_expect(t, alloc_owns(&slab, s1) && !alloc_owns(&slab, s2));
+	memset(s1, 3, 64);
+	s1 = alloc_realloc(&seg, s1, 64, 500);
+	testing_expect(t, s1 && !alloc_owns(&slab, s1));
+	testing_expect(t, bytes_is((void *)s1, 3, 64));
+	s2 = alloc_realloc(&seg, s2, 1000, 8);
+	testing_expect(t, s2 && alloc_owns(&slab, s2));
+	alloc_free(&seg, s1);
+	alloc_free(&seg, s2);
+	segregator_allocator_destroy(&seg);
+	//
+	Allocator tlsf = {0}, buckets = {0};
+	testing_expect(t, !tlsf_allocator_init(&tlsf, t->heap));
+	size_t limits[] = { 128, 4096, (size_t)-1 };
+	Allocator *children[] = { &slab, &tlsf, t->heap };
+	testing_expect(t, !bucketizer_allocator_init(
+		&buckets, t->heap, 3, limits, children
+	));
+	void *ptrs[3] = {
+		alloc_new(&buckets, 16),
+		alloc_new(&buckets, 2000),
+		alloc_new(&buckets, 100000),
+	};
+	testing_expect(t, alloc_owns(&slab, ptrs[0]));
+	testing_expect(t, alloc_owns(&tlsf, ptrs[1]) && !alloc_owns(&slab, ptrs[1]));
+	testing_expect(t, ptrs[2] && !alloc_owns(&tlsf, ptrs[2]));
+	testing_expect(t, alloc_owns(&buckets, ptrs[1]));
+	for (int i = 0; i < 3; i++) alloc_free(&buckets, ptrs[i]);
+	bucketizer_allocator_destroy(&buckets);
+	tlsf_allocator_destroy(&tlsf);
+	slab_allocator_destroy(&slab);
+}
+
+static void test_hugepage_allocator(testing_t *t) {
+	Allocator huge = {0}, arena = {0};
+	testing_expect(t, !hugepage_allocator_init(&huge, t->heap, 0));
+	char *p = alloc_new(&huge, HUGEPAGE_SIZE + 1);
+	testing_expect(t, p && !((size_t)p % HUGEPAGE_SIZE));
+	testing_expect(t, alloc_owns(&huge, p));
+	memset(p, 1, HUGEPAGE_SIZE + 1);
+	// grows in place while it fits the mapping
+	testing_expect(t, p == alloc_realloc(
+		&huge, p, HUGEPAGE_SIZE + 1, HUGEPAGE_SIZE*2
+	));
+	char *q = alloc_realloc(&huge, p, HUGEPAGE_SIZE*2, HUGEPAGE_SIZE*3);
+	testing_expect(t, q && !((size_t)q % HUGEPAGE_SIZE));
+	testing_expect(t, bytes_is((void *)q, 1, HUGEPAGE_SIZE + 1));
+	alloc_free(&huge, q);
+	// small requests go to the backing allocator
+	char *s = alloc_new(&huge, 100);
+	testing_expect(t, s && !hugepage_find(huge.state, s));
+	alloc_free(&huge, s);
+	// as the backing of an arena with huge blocks
+	testing_expect(t, !arena_init(&arena, &huge));
+	char *a = alloc_new(&arena, HUGEPAGE_SIZE*2);
+	testing_expect(t, a);
+	memset(a, 2, HUGEPAGE_SIZE*2);
+	arena_destroy(&arena);
+	// blocks the size of a huge page fill their mapping
+	testing_expect(t, !arena_init(&arena, &huge));
+	arena_set_block_size(&arena, HUGEPAGE_SIZE);
+	testing_expect(t, (a = alloc_new(&arena, 64)));
+	HugePageMapping *m = ((HugePageAllocator *)huge.state)->mappings;
+	testing_expect(t, m && !m->next && m->size == HUGEPAGE_SIZE);
+	testing_expect(t, alloc_new(&arena, HUGEPAGE_SIZE - 1024) && !m->next);
+	arena_destroy(&arena);
+	testing_expect(t, !((HugePageAllocator *)huge.state)->mappings);
+	hugepage_allocator_destroy(&huge);
+	// pre faulted mappings
+	testing_expect(t, !hugepage_allocator_init(
+		&huge, t->heap, HUGEPAGE_POPULATE
+	));
+	testing_expect(t, (p = alloc_new(&huge, HUGEPAGE_SIZE)));
+	testing_expect(t, bytes_is((void *)p, 0, HUGEPAGE_SIZE));
+	alloc_free_all(&huge);
+	testing_expect(t, !((HugePageAllocator *)huge.state)->mappings);
+	hugepage_allocator_destroy(&huge);
+}
+
+typedef struct BudgetTest {
+	int calls;
+	size_t used;
+	void *shed;
+} BudgetTest;
+
+static void budget_test_callback(Allocator *a, size_t used, void *ctx) {
+	BudgetTest *bt = ctx;
+	bt->calls++;
+	bt->used = used;
+	// a cache giving memory back under pressure
+	alloc_free(a, bt->shed);
+	bt->shed = 0;
+}
+
+static void test_budget_allocator(testing_t *t) {
+	Allocator budget = {0};
+	BudgetAllocator state = {0};
+	BudgetTest bt = {0};
+	testing_expect(t, !budget_allocator_init(
+		&budget, &state, t->heap, 1000, 600
+	));
+	budget_allocator_set_callback(&budget, &budget_test_callback, &bt);
+	bt.shed = alloc_new(&budget, 300);
+	char *p = alloc_new(&budget, 200);
+	testing_expect(t, p && bt.shed && !bt.calls);
+	testing_expect(t, budget_allocator_used(&budget) == 500);
+	// crossing the soft limit fires the callback once
+	char *q = alloc_new(&budget, 200);
+	testing_expect(t, q && bt.calls == 1 && !bt.shed && bt.used == 700);
+	testing_expect(t, budget_allocator_used(&budget) == 400);
+	// past the hard limit
+	testing_expect(t, !alloc_new(&budget, 601));
+	testing_expect(t, !alloc_realloc(&budget, q, 200, 801));
+	memset(q, 1, 200);
+	q = alloc_realloc(&budget, q, 200, 800);
+	testing_expect(t, q && bytes_is((void *)q, 1, 200));
+	testing_expect(t, budget_allocator_used(&budget) == 1000);
+	testing_expect(t, bt.calls == 2);
+	q = alloc_realloc(&budget, q, 800, 100);
+	testing_expect(t, budget_allocator_used(&budget) == 300);
+	char *r = alloc_new_aligned(&budget, 64, 64);
+	testing_expect(t, r && !((size_t)r % 64));
+	alloc_free(&budget, r);
+	alloc_free(&budget, q);
+	alloc_free(&budget, p);
+	testing_expect(t, budget_allocator_used(&budget) == 0);
+	budget_allocator_destroy(&budget);
+	// over an arena free all resets the arena and the budget
+	Allocator arena = {0};
+	testing_expect(t, !arena_init(&arena, t->heap));
+	testing_expect(t, !budget_allocator_init(
+		&budget, &state, &arena, 1000, 500
+	));
+	budget_allocator_set_callback(&budget, &budget_test_callback, &bt);
+	char *a1 = alloc_new(&budget, 600);
+	testing_expect(t, a1 && bt.calls == 3 && !alloc_new(&budget, 401));
+	alloc_free_all(&budget);
+	testing_expect(t, budget_allocator_used(&budget) == 0);
+	// the arena hands out the same memory again
+	testing_expect(t, alloc_new(&budget, 600) == a1);
+	testing_expect(t, bt.calls == 4 && alloc_new(&budget, 400));
+	testing_expect(t, budget_allocator_used(&budget) == 1000);
+	budget_allocator_destroy(&budget);
+	arena_destroy(&arena);
+}
+
+static void test_thread_cache_allocator(testing_t *t) {
+	Allocator tc = {0};
+	pthread_t threads[4] = {0};
+	void *ret = 0;
+	// the backing allocator is only reached with the lock held
+	testing_expect(t, !thread_cache_allocator_init(&tc, t->heap));
+	for (size_t i = 0; i < 4; i++) {
+		testing_expect(
+			t, !pthread_create(&threads[i], 0, &thread_cache_worker, &tc)
+		);
+	}
+	for (size_t i = 0; i < 4; i++) {
+		testing_expect(t, !pthread_join(threads[i], &ret));
+		testing_expect(t, !ret);
+	}
+	// big allocations bypass the caches
+	void *p = alloc_new(&tc, ((size_t)1) << 20);
+	testing_expect(t, p);
+	alloc_free(&tc, p);
+	thread_cache_allocator_destroy(&tc);
+}
+
+static void test_stats_allocator(testing_t *t) {
+	Allocator stats = {0};
+	StatsAllocator stats_state = {0};
+	AllocatorStats st = {0};
+	testing_expect(t, !stats_allocator_init(&stats, &stats_state, t->heap));
+	void *p = alloc_new(&stats, 100);
+	void *p2 = alloc_new(&stats, 1000);
+	void *p3 = alloc_new_aligned(&stats, 8, 64);
+	testing_expect(t, p && p2 && p3 && !((size_t)p3 % 64));
+	testing_expect(t, (p = alloc_realloc(&stats, p, 100, 300)));
+	alloc_free(&stats, p2);
+	stats_allocator_snapshot(&stats, &st);
+	testing_expect(t, st.allocs == 3);
+	testing_expect(t, st.reallocs == 1);
+	testing_expect(t, st.frees == 1);
+	testing_expect(t, st.live_bytes == 308);
+	testing_expect(t, st.peak_bytes == 1308);
+	// power of two size histogram
+	testing_expect(t, st.histogram[3] == 1);
+	testing_expect(t, st.histogram[6] == 1);
+	testing_expect(t, st.histogram[8] == 1);
+	testing_expect(t, st.histogram[9] == 1);
+	alloc_free(&stats, p);
+	alloc_free(&stats, p3);
+	stats_allocator_snapshot(&stats, &st);
+	testing_expect(t, st.live_bytes == 0);
+	stats_allocator_destroy(&stats);
+	// over an arena free all resets the arena and the live bytes, the other
+	// counters add up
+	Allocator arena = {0};
+	testing_expect(t, !arena_init(&arena, t->heap));
+	testing_expect(t, !stats_allocator_init(&stats, &stats_state, &arena));
+	char *a1 = alloc_new(&stats, 100);
+	testing_expect(t, a1);
+	alloc_free_all(&stats);
+	stats_allocator_snapshot(&stats, &st);
+	testing_expect(t, !st.live_bytes && st.peak_bytes == 100);
+	testing_expect(t, alloc_new(&stats, 50) == a1);
+	stats_allocator_snapshot(&stats, &st);
+	testing_expect(t, st.allocs == 2 && !st.frees && st.live_bytes == 50);
+	testing_expect(t, st.peak_bytes == 100);
+	stats_allocator_destroy(&stats);
+	arena_destroy(&arena);
 }
 
 static int char_cmp(void *ctx, void *item) {
@@ -168,6 +956,273 @@ static void test_slice(testing_t *t) {
 	heap_allocator_destroy(&a);
 }
 
+static void test_slice_splice(testing_t *t) {
+	Slice s = {0};
+	int v[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	int *base = 0;
+	slice_init(&s, t->heap, sizeof(int));
+	testing_expect(t, !slice_insert_multi(&s, 0, v, 8));
+	testing_expect(t, !slice_remove_range(&s, 2, 3));
+	base = (int *)s.base;
+	testing_expect(t, slice_len(&s) == 5 && base[1] == 1 && base[2] == 5);
+	testing_expect(t, !slice_insert_multi(&s, 0, v+6, 2));
+	testing_expect(t, !slice_oremove(&s, 2));
+	base = (int *)s.base;
+	testing_expect(t, base[0] == 6 && base[1] == 7 && base[2] == 1);
+	// replaces 1 5 with three items
+	testing_expect(t, !slice_splice(&s, 2, 2, v, 3));
+	base = (int *)s.base;
+	int want[] = { 6, 7, 0, 1, 2, 6, 7 };
+	testing_expect(t, slice_len(&s) == 7);
+	testing_expect(t, bytes_eq((void *)base, (void *)want, sizeof(want)));
+	testing_expect(t, slice_remove_range(&s, 5, 3));
+	testing_expect(t, slice_insert_multi(&s, 8, v, 1));
+	// reslices keep the offset in items and own a copy once they grow
+	Slice re = {0};
+	testing_expect(t, !slice_reslice(&s, &re, 2, 4));
+	testing_expect(t, slice_len(&re) == 2 && ((int *)re.base)[0] == 0);
+	testing_expect(t, !slice_insert_multi(&re, 1, v, 8));
+	testing_expect(t, !re.is_reslice && slice_len(&re) == 10);
+	testing_expect(t, ((int *)re.base)[0] == 0 && ((int *)re.base)[9] == 1);
+	testing_expect(t, base[2] == 0 && base[3] == 1 && base[4] == 2);
+	testing_expect(t, !slice_grow_cap_at(&re, 100));
+	testing_expect(t, ((int *)re.base)[9] == 1);
+	slice_destroy(&re);
+	slice_destroy(&s);
+}
+
+SLICE_DEFINE(u32, uint32_t)
+
+typedef struct TypedSlicePoint { int x, y; } TypedSlicePoint;
+SLICE_DEFINE(point, TypedSlicePoint)
+
+static void test_typed_slice(testing_t *t) {
+	Slice_u32 s = {0};
+	slice_u32_init(&s, t->heap);
+	for (uint32_t i = 0; i < 1000; i++) {
+		testing_expect(t, !slice_u32_append(&s, i));
+	}
+	testing_expect(t, slice_u32_len(&s) == 1000);
+	testing_expect(t, slice_u32_get(&s, 999) == 999);
+	slice_u32_set(&s, 0, 7);
+	*slice_u32_at(&s, 1) += 10;
+	uint32_t sum = 0;
+	for (uint32_t *p = slice_u32_begin(&s); p != slice_u32_end(&s); p++) {
+		sum += *p;
+	}
+	testing_expect(t, sum == 999*1000/2 + 7 + 10);
+	// the same Slice for the type erased functions
+	uint32_t v = 0;
+	testing_expect(t, !slice_get(&s.s, 1, &v) && v == 11);
+	v = 5;
+	testing_expect(t, !slice_append(&s.s, &v));
+	testing_expect(t, !slice_u32_pop(&s, &v) && v == 5);
+	slice_destroy(&s.s);
+	//
+	Slice_point pts = {0};
+	slice_point_init(&pts, t->heap);
+	testing_expect(t, !slice_point_append(&pts, (TypedSlicePoint){1, 2}));
+	testing_expect(t, slice_point_get(&pts, 0).y == 2);
+	// growing a reslice copies its items
+	Slice_point re = {0};
+	testing_expect(t, !slice_reslice(&pts.s, &re.s, 0, 1));
+	for (int i = 0; i < 10; i++) {
+		testing_expect(t, !slice_point_append(&re, (TypedSlicePoint){i, i}));
+	}
+	testing_expect(t, slice_point_get(&re, 0).x == 1);
+	testing_expect(t, slice_point_get(&re, 10).x == 9);
+	slice_destroy(&re.s);
+	slice_destroy(&pts.s);
+}
+
+static int sort_test_cmp_int(void *ctx, void *a, void *b) {
+	(void)ctx;
+	int x = *(int *)a, y = *(int *)b;
+	return (x > y) - (x < y);
+}
+
+// 24 bytes, swapped by the generic path
+typedef struct SortTestItem {
+	int64_t key;
+	int64_t seq;
+	int64_t pad;
+} SortTestItem;
+
+static int sort_test_cmp_item(void *ctx, void *a, void *b) {
+	(void)ctx;
+	int64_t x = ((SortTestItem *)a)->key, y = ((SortTestItem *)b)->key;
+	return (x > y) - (x < y);
+}
+
+static void test_slice_sort(testing_t *t) {
+	Slice s = {0};
+	int ok = 1;
+	uint32_t seed = 1;
+	slice_init(&s, t->heap, sizeof(int));
+	for (int i = 0; i < 5000; i++) {
+		seed = seed*1103515245 + 12345;
+		int v = (int)(seed >> 16) % 1000 - 500;
+		testing_expect(t, !slice_append(&s, &v));
+	}
+	slice_sort(&s, 0, sort_test_cmp_int);
+	int *base = (int *)s.base;
+	for (size_t i = 1; i < slice_len(&s); i++) ok &= base[i-1] <= base[i];
+	testing_expect(t, ok);
+	size_t lb = 0, at = 0;
+	int key = base[2500];
+	lb = slice_lower_bound(&s, &key, 0, sort_test_cmp_int);
+	testing_expect(t, base[lb] == key && (!lb || base[lb-1] < key));
+	testing_expect(t, slice_bsearch(&s, &key, 0, sort_test_cmp_int, &at));
+	testing_expect(t, *(int *)at == key);
+	key = 1000;
+	testing_expect(t, !slice_bsearch(&s, &key, 0, sort_test_cmp_int, &at));
+	testing_expect(t, slice_lower_bound(&s, &key, 0, sort_test_cmp_int) == 5000);
+	// already sorted and reversed input stay within the depth limit
+	for (size_t i = 0; i < 2500; i++) {
+		int tmp = base[i];
+		base[i] = base[4999-i];
+		base[4999-i] = tmp;
+	}
+	slice_sort(&s, 0, sort_test_cmp_int);
+	ok = 1;
+	for (size_t i = 1; i < slice_len(&s); i++) ok &= base[i-1] <= base[i];
+	testing_expect(t, ok);
+	slice_destroy(&s);
+
+	// equal keys keep their order
+	slice_init(&s, t->heap, sizeof(SortTestItem));
+	for (int64_t i = 0; i < 3000; i++) {
+		seed = seed*1103515245 + 12345;
+		SortTestItem it = { .key = (seed >> 16) % 50 - 25, .seq = i };
+		testing_expect(t, !slice_append(&s, &it));
+	}
+	Slice copy = {0};
+	slice_init(&copy, t->heap, sizeof(SortTestItem));
+	testing_expect(t, !slice_append_multi(&copy, s.base, slice_len(&s)));
+	testing_expect(t, !slice_sort_stable(&s, 0, sort_test_cmp_item));
+	SortTestItem *items = (SortTestItem *)s.base;
+	ok = 1;
+	for (size_t i = 1; i < slice_len(&s); i++) {
+		ok &= items[i-1].key < items[i].key ||
+			(items[i-1].key == items[i].key && items[i-1].seq < items[i].seq);
+	}
+	testing_expect(t, ok);
+	// the radix sort is stable too and orders negative keys first
+	testing_expect(t, !slice_radix_sort(&copy, 0, sizeof(int64_t), 1));
+	testing_expect(t, bytes_eq(
+		(void *)copy.base, (void *)s.base, 3000*sizeof(SortTestItem)
+	));
+	testing_expect(t, slice_radix_sort(&copy, 20, 8, 0) == -2);
+	slice_sort(&copy, 0, sort_test_cmp_item);
+	items = (SortTestItem *)copy.base;
+	ok = 1;
+	for (size_t i = 1; i < slice_len(&copy); i++) {
+		ok &= items[i-1].key <= items[i].key;
+	}
+	testing_expect(t, ok);
+	slice_destroy(&copy);
+	slice_destroy(&s);
+
+	slice_init(&s, t->heap, sizeof(uint32_t));
+	for (int i = 0; i < 4000; i++) {
+		seed = seed*1103515245 + 12345;
+		uint32_t v = seed;
+		testing_expect(t, !slice_append(&s, &v));
+	}
+	testing_expect(t, !slice_radix_sort(&s, 0, sizeof(uint32_t), 0));
+	uint32_t *u = (uint32_t *)s.base;
+	ok = 1;
+	for (size_t i = 1; i < slice_len(&s); i++) ok &= u[i-1] <= u[i];
+	testing_expect(t, ok);
+	slice_destroy(&s);
+}
+
+static void test_seg_slice(testing_t *t) {
+	SegSlice s = {0};
+	size_t p0 = 0, p1000 = 0, at = 0, count = 0, total = 0;
+	int v = 0, ok = 1;
+	seg_slice_init(&s, t->heap, sizeof(int), 10);
+	testing_expect(t, s.shift == 4);
+	testing_expect(t, seg_slice_get(&s, 0, &v) == 1);
+	for (int i = 0; i < 2000; i++) testing_expect(t, !seg_slice_append(&s, &i));
+	testing_expect(t, !seg_slice_get_ptr(&s, 0, &p0));
+	testing_expect(t, !seg_slice_get_ptr(&s, 1000, &p1000));
+	// a run spanning several segments
+	int run[300];
+	for (int i = 0; i < 300; i++) run[i] = 2000 + i;
+	for (int i = 0; i < 100; i++) {
+		testing_expect(t, !seg_slice_append_multi(&s, run, 300));
+		for (int j = 0; j < 300; j++) run[j] += 300;
+	}
+	testing_expect(t, seg_slice_len(&s) == 32000);
+	testing_expect(t, seg_slice_cap(&s) >= 32000);
+	// growing never moved the items
+	testing_expect(t, !seg_slice_get_ptr(&s, 0, &at) && at == p0);
+	testing_expect(t, !seg_slice_get_ptr(&s, 1000, &at) && at == p1000);
+	for (size_t i = 0; i < seg_slice_len(&s); i++) {
+		ok &= !seg_slice_get(&s, i, &v) && v == (int)i;
+	}
+	testing_expect(t, ok);
+	ok = 1;
+	for (size_t k = 0, i = 0; k < SEG_SLICE_SEGMENTS; k++) {
+		int *items = seg_slice_segment(&s, k, &count);
+		if (!items) break;
+		for (size_t j = 0; j < count; j++, i++) ok &= items[j] == (int)i;
+		total += count;
+	}
+	testing_expect(t, ok && total == 32000);
+	v = -1;
+	testing_expect(t, !seg_slice_set(&s, 31999, &v));
+	testing_expect(t, seg_slice_set(&s, 32000, &v) == 1);
+	testing_expect(t, !seg_slice_pop(&s, &v) && v == -1);
+	testing_expect(t, !seg_slice_pop(&s, &v) && v == 31998);
+	size_t cap = seg_slice_cap(&s);
+	seg_slice_reset(&s);
+	testing_expect(t, seg_slice_pop(&s, &v) == -1 && !v);
+	for (int i = 0; i < 100; i++) testing_expect(t, !seg_slice_append(&s, &i));
+	testing_expect(t, seg_slice_cap(&s) == cap);
+	testing_expect(t, *(int *)seg_slice_at(&s, 99) == 99);
+	seg_slice_destroy(&s);
+	testing_expect(t, !s.nsegs && !s.a);
+}
+
+SLICE_SMALL_DEFINE(small_int, int, 16)
+
+static void test_small_slice(testing_t *t) {
+	Allocator stats = {0};
+	StatsAllocator stats_state = {0};
+	AllocatorStats st = {0};
+	SliceSmall_small_int s = {0};
+	int v = 0, ok = 1;
+	testing_expect(t, !stats_allocator_init(&stats, &stats_state, t->heap));
+	slice_small_small_int_init(&s, &stats);
+	for (int i = 0; i < 16; i++) testing_expect(t, !slice_append(&s.s, &i));
+	testing_expect(t, !slice_oremove(&s.s, 0));
+	testing_expect(t, !slice_insert_multi(&s.s, 0, &v, 1));
+	testing_expect(t, !slice_pop(&s.s, &v) && v == 15);
+	stats_allocator_snapshot(&stats, &st);
+	// sixteen items never left the struct
+	testing_expect(t, !st.allocs && slice_small_small_int_is_inline(&s));
+	testing_expect(t, slice_len(&s.s) == 15 && slice_cap(&s.s) == 16);
+	for (int i = 15; i < 40; i++) testing_expect(t, !slice_append(&s.s, &i));
+	stats_allocator_snapshot(&stats, &st);
+	testing_expect(t, st.allocs == 1 && !slice_small_small_int_is_inline(&s));
+	for (size_t i = 0; i < slice_len(&s.s); i++) {
+		ok &= !slice_get(&s.s, i, &v) && v == (int)i;
+	}
+	testing_expect(t, ok && slice_len(&s.s) == 40);
+	slice_destroy(&s.s);
+	stats_allocator_snapshot(&stats, &st);
+	testing_expect(t, st.frees == 1 && !st.live_bytes);
+	// a slice that never spilled has nothing to free
+	slice_small_small_int_init(&s, &stats);
+	testing_expect(t, !slice_append(&s.s, &v));
+	slice_destroy(&s.s);
+	stats_allocator_snapshot(&stats, &st);
+	testing_expect(t, st.allocs == 1 && st.frees == 1);
+	stats_allocator_destroy(&stats);
+}
+
 void test_leak_detection(testing_t *t) {
 	void *a, *b, *c, *d, *e;
 	testing_expect(t, (a = alloc_new(t->arena, 1)));
@@ -295,8 +1350,29 @@ int main(void) {
 	testing_init(&tr);
 	//
 	testing_add(&tr, test_arena);
+	testing_add(&tr, test_arena_mark);
+	testing_add(&tr, test_arena_retention);
+	testing_add(&tr, test_arena_waste);
+	testing_add(&tr, test_arena_stats);
+	testing_add(&tr, test_alloc_fast);
+	testing_add(&tr, test_alloc_batch);
+	testing_add(&tr, test_vm_arena);
+	testing_add(&tr, test_concurrent_arena);
+	testing_add(&tr, test_aligned_alloc);
 	testing_add(&tr, test_heap_allocator);
+	testing_add(&tr, test_stats_allocator);
+	testing_add(&tr, test_slab_allocator);
+	testing_add(&tr, test_thread_cache_allocator);
+	testing_add(&tr, test_tlsf_allocator);
+	testing_add(&tr, test_compose_allocator);
+	testing_add(&tr, test_hugepage_allocator);
+	testing_add(&tr, test_budget_allocator);
 	testing_add(&tr, test_slice);
+	testing_add(&tr, test_typed_slice);
+	testing_add(&tr, test_slice_splice);
+	testing_add(&tr, test_slice_sort);
+	testing_add(&tr, test_seg_slice);
+	testing_add(&tr, test_small_slice);
 	testing_add(&tr, test_leak_detection);
 	testing_add(&tr, test_errors);
 	testing_add(&tr, test_buffer);